@@ -0,0 +1,104 @@
+/*!
+ * Copyright (c) 2016 by Contributors
+ */
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "mxnet-cpp/MxNetCpp.h"
+using namespace std;
+using namespace mxnet::cpp;
+
+/*
+ * This example measures the per-step latency of the two ways of feeding an
+ * executor:
+ *   1. SimpleBind a new executor for every mini-batch, as most of the
+ *      examples do, which re-runs shape inference and re-allocates all the
+ *      gradient arrays every step;
+ *   2. bind once and copy every mini-batch into the input slots in place.
+ * */
+
+Symbol MLPSymbol() {
+  auto data = Symbol::Variable("data");
+  auto label = Symbol::Variable("label");
+  vector<int> layer_sizes({512, 512, 10});
+  Symbol out = data;
+  for (size_t i = 0; i < layer_sizes.size(); ++i) {
+    string istr = to_string(i);
+    out = FullyConnected(string("fc") + istr, out,
+                         Symbol::Variable(string("w") + istr),
+                         Symbol::Variable(string("b") + istr), layer_sizes[i]);
+    if (i + 1 < layer_sizes.size()) {
+      out = Activation(string("relu") + istr, out, ActivationActType::relu);
+    }
+  }
+  return SoftmaxOutput("softmax", out, label);
+}
+
+int main(int argc, char const *argv[]) {
+  int batch_size = 32;
+  int num_feature = 784;
+  int num_batch = 16;
+  int num_step = 500;
+  auto ctx = Context::cpu();
+  auto net = MLPSymbol();
+
+  /*a few host batches to cycle through*/
+  NDArray all_data(Shape(batch_size * num_batch, num_feature), ctx, false);
+  NDArray all_label(Shape(batch_size * num_batch), ctx, false);
+  NDArray::SampleUniform(0, 1, &all_data);
+  all_label = 1;
+  NDArray::WaitAll();
+
+  map<string, NDArray> args_map;
+  args_map["data"] = all_data.Slice(0, batch_size).Copy(ctx);
+  args_map["label"] = all_label.Slice(0, batch_size).Copy(ctx);
+  net.InferArgsMap(ctx, &args_map, args_map);
+  NDArray::WaitAll();
+
+  /*warm up the engine and the memory pool*/
+  {
+    auto *exec = net.SimpleBind(ctx, args_map);
+    exec->Forward(true);
+    exec->Backward();
+    NDArray::WaitAll();
+    delete exec;
+  }
+
+  auto begin = chrono::steady_clock::now();
+  for (int step = 0; step < num_step; ++step) {
+    int start = (step % num_batch) * batch_size;
+    args_map["data"] = all_data.Slice(start, start + batch_size).Copy(ctx);
+    args_map["label"] = all_label.Slice(start, start + batch_size).Copy(ctx);
+    NDArray::WaitAll();
+    auto *exec = net.SimpleBind(ctx, args_map);
+    exec->Forward(true);
+    exec->Backward();
+    NDArray::WaitAll();
+    delete exec;
+  }
+  auto end = chrono::steady_clock::now();
+  double rebind_ms =
+      chrono::duration<double, milli>(end - begin).count() / num_step;
+
+  auto *exec = net.SimpleBind(ctx, args_map);
+  begin = chrono::steady_clock::now();
+  for (int step = 0; step < num_step; ++step) {
+    int start = (step % num_batch) * batch_size;
+    exec->SetInput("data", all_data.Slice(start, start + batch_size));
+    exec->SetInput("label", all_label.Slice(start, start + batch_size));
+    exec->Forward(true);
+    exec->Backward();
+    NDArray::WaitAll();
+  }
+  end = chrono::steady_clock::now();
+  double bound_ms =
+      chrono::duration<double, milli>(end - begin).count() / num_step;
+  delete exec;
+
+  LG << "SimpleBind per batch: " << rebind_ms << " ms/step";
+  LG << "bind once, SetInput:  " << bound_ms << " ms/step";
+  LG << "speedup: " << rebind_ms / bound_ms << "x";
+  return 0;
+}
@@ -45,20 +45,10 @@ class FeatureExtractor {
   }
   /*Fill the trained paramters into the model, a.k.a. net, executor*/
   void LoadParameters() {
-    map<string, NDArray> paramters;
-    NDArray::Load("./model/Inception_BN-0039.params", 0, &paramters);
-    for (const auto &k : paramters) {
-      if (k.first.substr(0, 4) == "aux:") {
-        auto name = k.first.substr(4, k.first.size() - 4);
-        aux_map[name] = k.second.Copy(global_ctx);
-      }
-      if (k.first.substr(0, 4) == "arg:") {
-        auto name = k.first.substr(4, k.first.size() - 4);
-        args_map[name] = k.second.Copy(global_ctx);
-      }
-    }
-    /*WaitAll is need when we copy data between GPU and the main memory*/
-    NDArray::WaitAll();
+    /*the arrays are copied to global_ctx while the next ones are read*/
+    NDArrayLoader loader("./model/Inception_BN-0039.params");
+    args_map = loader.Load("arg:", global_ctx);
+    aux_map = loader.Load("aux:", global_ctx);
   }
   void GetMeanImg() {
     mean_img = NDArray(Shape(1, 3, 224, 224), global_ctx, false);
@@ -85,23 +75,24 @@ class FeatureExtractor {
     executor = net.SimpleBind(global_ctx, args_map, map<string, NDArray>(),
                               map<string, OpReqType>(), aux_map);
     executor->Forward(false);
-    /*print out the features*/
-    auto array = executor->outputs[0].Copy(Context(kCPU, 0));
-    NDArray::WaitAll();
+    /*print out the features, the view reads the host copy in place*/
+    NDArray output = executor->outputs[0].Copy(Context(kCPU, 0));
+    mx_uint num = output.GetShapeRef()[0];
+    NDArrayView<const mx_float> features(
+        output.Reshape(Shape(num, output.Size() / num)));
     for (int i = 0; i < 1024; ++i) {
-      cout << array.At(0, i) << ",";
+      cout << features(0, i) << ",";
     }
     cout << endl;
   }
 };
 
 NDArray Data2NDArray() {
-  NDArray ret(Shape(2, 3, 224, 224), global_ctx, false);
-  ifstream inf("./img.dat", ios::binary);
-  vector<float> data(2 * 3 * 224 * 224);
-  inf.read(reinterpret_cast<char *>data.data(), 2 * 3 * 224 * 224 * sizeof(float));
-  inf.close();
-  ret.SyncCopyFromCPU(data.data(), 2 * 3 * 224 * 224);
+  /*the file is mapped, the pictures are copied straight from its pages*/
+  MmapIter iter("./img.dat", 2, global_ctx);
+  iter.BeforeFirst();
+  CHECK(iter.Next());
+  NDArray ret = iter.GetData();
   NDArray::WaitAll();
   return ret;
 }
@@ -110,7 +101,7 @@ int main() {
   /*
    * get the data from a binary file ./img.data
    * this file is generated by ./prepare_data_with_opencv
-   * it stores 2 pictures in NDArray format
+   * it stores 2 pictures in the mmap dataset format
    *
    */
   auto data = Data2NDArray();
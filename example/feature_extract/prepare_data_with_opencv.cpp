@@ -6,10 +6,12 @@
 #include <string>
 #include <vector>
 #include <opencv2/opencv.hpp>
+#include "mxnet-cpp/MxNetCpp.h"
 
 using namespace std;
+using namespace mxnet::cpp;
 
-/*read images and store them the NDArray format that MXNet.cpp can handle*/
+/*read images and store them in the mmap dataset format of MmapIter*/
 void Mat2Array() {
   string file_name_list[] = {"./1.jpg", "./2.jpg"};
 
@@ -26,9 +28,9 @@ void Mat2Array() {
       }
     }
   }
-  ofstream outf("./img.dat", ios::binary);
-  outf.write(reinterpret_cast<char *>array.data(), array.size() * sizeof(float));
-  outf.close();
+  MmapWriter writer("./img.dat", Shape(3, 224, 224));
+  writer.Write(array.data(), nullptr, 2);
+  writer.Close();
 }
 
 int main(int argc, char *argv[]) {
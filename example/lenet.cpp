@@ -117,32 +117,30 @@ class Lenet {
         .SetParam("rescale_grad", 1.0)
         .SetParam("clip_gradient", 10);
 
+    /*bind once, the batches are copied into the input slots in place*/
+    Executor *exe = lenet.SimpleBind(ctx_dev, args_map);
+
     for (int ITER = 0; ITER < max_epoch; ++ITER) {
       size_t start_index = 0;
       while (start_index < train_num) {
         if (start_index + batch_size > train_num) {
           start_index = train_num - batch_size;
         }
-        args_map["data"] =
-            train_data.Slice(start_index, start_index + batch_size)
-                .Copy(ctx_dev);
-        args_map["data_label"] =
-            train_label.Slice(start_index, start_index + batch_size)
-                .Copy(ctx_dev);
+        exe->SetInput("data",
+                      train_data.Slice(start_index, start_index + batch_size));
+        exe->SetInput("data_label",
+                      train_label.Slice(start_index, start_index + batch_size));
         start_index += batch_size;
-        NDArray::WaitAll();
 
-        Executor *exe = lenet.SimpleBind(ctx_dev, args_map);
         exe->Forward(true);
         exe->Backward();
         exe->UpdateAll(&opt, learning_rate, weight_decay);
-
-        delete exe;
       }
 
       LG << "Iter " << ITER
-         << ", accuracy: " << ValAccuracy(batch_size * 10, lenet);
+         << ", accuracy: " << ValAccuracy(batch_size * 10, exe);
     }
+    delete exe;
   }
 
  private:
@@ -155,72 +153,57 @@ class Lenet {
   NDArray val_label;
 
   size_t GetData(vector<float> *data, vector<float> *label) {
-    const char *train_data_path = "./train.csv";
-    ifstream inf(train_data_path);
-    string line;
-    inf >> line;  // ignore the header
-    size_t _N = 0;
-    while (inf >> line) {
-      for (auto &c : line) c = (c == ',') ? ' ' : c;
-      stringstream ss;
-      ss << line;
-      float _data;
-      ss >> _data;
-      label->push_back(_data);
-      while (ss >> _data) data->push_back(_data / 256.0);
-      _N++;
-    }
-    inf.close();
-    return _N;
+    /*the first column is the label, the others the pixels*/
+    size_t num = CSVIter::Parse("./train.csv", 0, true, data, label);
+    for (auto &d : *data) d /= 256.0;
+    return num;
   }
 
-  float ValAccuracy(int batch_size, Symbol lenet) {
+  float ValAccuracy(int batch_size, Executor *train_exe) {
     size_t val_num = val_data.GetShape()[0];
 
     size_t correct_count = 0;
     size_t all_count = 0;
 
+    /*the validation batch size differs, reshape the training executor so
+     * the parameters and the memory pool are shared*/
+    map<string, vector<mx_uint> > val_shapes;
+    val_shapes["data"] = {mx_uint(batch_size), 1, 28, 28};
+    val_shapes["data_label"] = {mx_uint(batch_size)};
+    Executor *exe = train_exe->Reshape(val_shapes, false, true);
+
     size_t start_index = 0;
     while (start_index < val_num) {
       if (start_index + batch_size > val_num) {
         start_index = val_num - batch_size;
       }
-      args_map["data"] =
-          val_data.Slice(start_index, start_index + batch_size).Copy(ctx_dev);
-      args_map["data_label"] =
-          val_label.Slice(start_index, start_index + batch_size).Copy(ctx_dev);
+      exe->SetInput("data",
+                    val_data.Slice(start_index, start_index + batch_size));
+      exe->SetInput("data_label",
+                    val_label.Slice(start_index, start_index + batch_size));
       start_index += batch_size;
-      NDArray::WaitAll();
 
-      Executor *exe = lenet.SimpleBind(ctx_dev, args_map);
       exe->Forward(false);
 
-      const auto &out = exe->outputs;
-      NDArray out_cpu = out[0].Copy(ctx_cpu);
-      NDArray label_cpu =
-          val_label.Slice(start_index - batch_size, start_index).Copy(ctx_cpu);
-
-      NDArray::WaitAll();
-
-      const mx_float *dptr_out = out_cpu.GetData();
-      const mx_float *dptr_label = label_cpu.GetData();
+      /*the views wait for the pending writes of their own arrays only*/
+      NDArrayView<const mx_float> out(exe->outputs[0].Copy(ctx_cpu));
+      NDArrayView<const mx_float> label(
+          val_label.Slice(start_index - batch_size, start_index));
+      int cat_num = out.GetShape()[1];
       for (int i = 0; i < batch_size; ++i) {
-        float label = dptr_label[i];
-        int cat_num = out_cpu.GetShape()[1];
-        float p_label = 0, max_p = dptr_out[i * cat_num];
+        float p_label = 0, max_p = out(i, 0);
         for (int j = 0; j < cat_num; ++j) {
-          float p = dptr_out[i * cat_num + j];
+          float p = out(i, j);
           if (max_p < p) {
             p_label = j;
             max_p = p;
           }
         }
-        if (label == p_label) correct_count++;
+        if (label[i] == p_label) correct_count++;
       }
       all_count += batch_size;
-
-      delete exe;
     }
+    delete exe;
     return correct_count * 1.0 / all_count;
   }
 };
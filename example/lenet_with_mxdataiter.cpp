@@ -83,35 +83,36 @@ int main(int argc, char const *argv[]) {
   opt.SetParam("momentum", 0.9).SetParam("rescale_grad", 1.0).SetParam(
       "clip_gradient", 10);
 
+  /*bind once, then feed every batch through the input slots in place*/
+  auto *exec = lenet.SimpleBind(Context::gpu(), args_map);
+
+  /*load and copy the next batches to the device while training*/
+  PrefetchingIter train_prefetch(&train_iter, Context::gpu());
+
   for (int iter = 0; iter < max_epoch; ++iter) {
     LG << "Epoch: " << iter;
-    train_iter.Reset();
-    while (train_iter.Next()) {
-      auto data_batch = train_iter.GetDataBatch();
-      args_map["data"] = data_batch.data.Copy(Context::gpu());
-      args_map["data_label"] = data_batch.label.Copy(Context::gpu());
-      NDArray::WaitAll();
-      auto *exec = lenet.SimpleBind(Context::gpu(), args_map);
+    train_prefetch.Reset();
+    while (train_prefetch.Next()) {
+      auto data_batch = train_prefetch.GetDataBatch();
+      exec->SetInput("data", data_batch.data);
+      exec->SetInput("data_label", data_batch.label);
       exec->Forward(true);
       exec->Backward();
       exec->UpdateAll(&opt, learning_rate, weight_decay);
-      delete exec;
     }
 
     Accuracy acu;
     val_iter.Reset();
     while (val_iter.Next()) {
       auto data_batch = val_iter.GetDataBatch();
-      args_map["data"] = data_batch.data.Copy(Context::gpu());
-      args_map["data_label"] = data_batch.label.Copy(Context::gpu());
-      NDArray::WaitAll();
-      auto *exec = lenet.SimpleBind(Context::gpu(), args_map);
+      exec->SetInput("data", data_batch.data);
+      exec->SetInput("data_label", data_batch.label);
       exec->Forward(false);
       NDArray::WaitAll();
       acu.Update(data_batch.label, exec->outputs[0]);
-      delete exec;
     }
     LG << "Accuracy: " << acu.Get();
   }
+  delete exec;
   return 0;
 }
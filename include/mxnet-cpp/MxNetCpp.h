@@ -9,11 +9,17 @@
 #define MXNETCPP_H_
 
 #include "mxnet-cpp/executor.hpp"
+#include "mxnet-cpp/executor_cache.hpp"
 #include "mxnet-cpp/symbol.hpp"
 #include "mxnet-cpp/ndarray.hpp"
+#include "mxnet-cpp/ndarray_view.h"
+#include "mxnet-cpp/ndarray_loader.h"
 #include "mxnet-cpp/operator.hpp"
 #include "mxnet-cpp/optimizer.hpp"
 #include "mxnet-cpp/kvstore.hpp"
+#include "mxnet-cpp/trainer.hpp"
+#include "mxnet-cpp/executor_group.hpp"
+#include "mxnet-cpp/model.hpp"
 #include "mxnet-cpp/op.h"
 #include "mxnet-cpp/op_suppl.h"
 #include "mxnet-cpp/io.hpp"
@@ -11,6 +11,13 @@
 #include <cstdlib>
 #include "mxnet-cpp/c_api.h"
 
+/*! \brief warn when the result of a function is discarded */
+#if defined(__GNUC__) || defined(__clang__)
+#define MXNETCPP_NODISCARD __attribute__((warn_unused_result))
+#else
+#define MXNETCPP_NODISCARD
+#endif
+
 namespace mxnet {
 namespace cpp {
 
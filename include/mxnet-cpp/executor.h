@@ -33,19 +33,25 @@ class Executor {
            const std::map<std::string, Context> &group_to_ctx =
                std::map<std::string, Context>(),
            Executor *shared_exec = nullptr);
-  explicit Executor(const ExecutorHandle &h) { handle_ = h; }
+  /*!
+  * \brief wrap an executor bound elsewhere
+  * \param h the handle, freed by this executor
+  * \param symbol the symbol h was bound from, needed by SetInput and
+  *  GetArgIndex to find the arguments by name
+  * \param arg_arrays the arguments h was bound with, in the order of
+  *  symbol.ListArguments()
+  */
+  explicit Executor(const ExecutorHandle &h, const Symbol &symbol = Symbol(),
+                    const std::vector<NDArray> &arg_arrays =
+                        std::vector<NDArray>());
   /*!
   * \brief Perform a Forward operation of Operator
   *  After this operation, user can get the result by using function head.
+  *  The output arrays are fixed at binding time, so outputs keeps referring
+  *  to the same NDArrays across calls.
   */
   void Forward(bool is_train) {
-    MXExecutorForward(handle_, is_train ? 1 : 0);
-    mx_uint out_size;
-    NDArrayHandle *out_array;
-    CHECK_EQ(MXExecutorOutputs(handle_, &out_size, &out_array), 0);
-    for (mx_uint i = 0; i < out_size; ++i) {
-      outputs[i] = NDArray(out_array[i]);
-    }
+    CHECK_EQ(MXExecutorForward(handle_, is_train ? 1 : 0), 0);
   }
   /*!
   * \brief Perform a Backward operation of the Operator.
@@ -69,9 +75,47 @@ class Executor {
       MXExecutorBackward(handle_, 0, nullptr);
     }
   }
-  // TODO(zhangchen-qinyinghua)
-  // To implement reshape function
-  void Reshape();
+  /*!
+  * \brief copy the content of value into the bound argument slot in place.
+  *  The executor is bound once and fed batch after batch through its input
+  *  slots, so a steady-state step performs no binding and no allocation.
+  *  The copy is pushed to the engine, no synchronization is needed.
+  * \param name name of the argument, e.g. "data"
+  * \param value the array to copy from, must have the shape of the slot
+  */
+  void SetInput(const std::string &name, const NDArray &value);
+  /*!
+  * \brief copy a continugous CPU memory region into the bound argument slot
+  *  The copy is synchronous: it waits for the pending operations on the
+  *  slot and returns once the data is copied, so data can be reused.
+  * \param name name of the argument, e.g. "data"
+  * \param data the data source to copy from
+  * \param size the number of elements to copy
+  */
+  void SetInput(const std::string &name, const mx_float *data, size_t size);
+  /*!
+  * \param name name of the argument
+  * \return the position of the argument in arg_arrays
+  */
+  size_t GetArgIndex(const std::string &name) const;
+  /*!
+  * \brief Return a new executor with the same symbol and new input shapes.
+  *  The new executor is bound with this one as shared_exec, so it reuses
+  *  its memory pool; arrays whose shape is unchanged are shared as they are
+  *  and arrays that shrink become views of the existing ones. Changing the
+  *  batch size therefore costs a shape inference instead of a full
+  *  reallocation. The returned executor shares state with this one, and
+  *  should not be used in parallel with it.
+  * \param input_shapes map of argument name to its new shape
+  * \param partial_shaping whether to allow the shape of arguments not given
+  *  in input_shapes to change
+  * \param allow_up_sizing whether to allow allocating new arrays when a new
+  *  shape is larger than the current one
+  * \return a new executor, which need to be free manually.
+  */
+  Executor *Reshape(
+      const std::map<std::string, std::vector<mx_uint> > &input_shapes,
+      bool partial_shaping = false, bool allow_up_sizing = false);
   /*!
   * \brief update the arguments with given learning rate and optimizer
   * \return the SymbolHandle
@@ -115,6 +159,19 @@ class Executor {
   Executor &operator=(const Executor &e);
   ExecutorHandle handle_;
   Symbol symbol_;
+  Context context_;
+  std::vector<OpReqType> grad_reqs_;
+  std::map<std::string, Context> group_to_ctx_;
+  std::map<std::string, size_t> arg_index_;
+  /*! \brief the lists UpdateAll passes to the optimizer, built once */
+  std::vector<int> update_indices_;
+  std::vector<NDArray> update_weights_, update_grads_;
+  /*! \brief fill arg_index_ from symbol_ and arg_arrays */
+  void BuildArgIndex();
+  static NDArray ReshapeArray(const NDArray &array,
+                              const std::vector<mx_uint> &new_shape,
+                              const std::string &name, bool allow_change,
+                              bool allow_up_sizing);
   std::map<std::string, NDArray> GetDict(const std::vector<std::string> &names,
                                          const std::vector<NDArray> &arrays) {
     std::map<std::string, NDArray> ret;
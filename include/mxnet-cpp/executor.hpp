@@ -8,6 +8,7 @@
 #ifndef MXNETCPP_EXECUTOR_HPP
 #define MXNETCPP_EXECUTOR_HPP
 
+#include <algorithm>
 #include <vector>
 #include <map>
 #include <string>
@@ -22,7 +23,8 @@ Executor::Executor(const Symbol &symbol, Context context,
                    const std::vector<OpReqType> &grad_reqs,
                    const std::vector<NDArray> &aux_arrays,
                    const std::map<std::string, Context> &group_to_ctx,
-                   Executor *shared_exec) {
+                   Executor *shared_exec)
+    : context_(context), grad_reqs_(grad_reqs), group_to_ctx_(group_to_ctx) {
   this->arg_arrays = arg_arrays;
   this->grad_arrays = grad_arrays;
   this->aux_arrays = aux_arrays;
@@ -71,6 +73,107 @@ Executor::Executor(const Symbol &symbol, Context context,
   for (mx_uint i = 0; i < out_size; ++i) {
     outputs.push_back(NDArray(out_array[i]));
   }
+
+  BuildArgIndex();
+}
+
+Executor::Executor(const ExecutorHandle &h, const Symbol &symbol,
+                   const std::vector<NDArray> &arg_arrays)
+    : context_(Context::cpu()) {
+  handle_ = h;
+  mx_uint out_size;
+  NDArrayHandle *out_array;
+  CHECK_EQ(MXExecutorOutputs(handle_, &out_size, &out_array), 0);
+  for (mx_uint i = 0; i < out_size; ++i) {
+    outputs.push_back(NDArray(out_array[i]));
+  }
+  if (arg_arrays.empty()) return;
+  this->arg_arrays = arg_arrays;
+  this->symbol_ = symbol;
+  BuildArgIndex();
+}
+
+void Executor::BuildArgIndex() {
+  const auto arg_names = symbol_.ListArguments();
+  CHECK_EQ(arg_names.size(), arg_arrays.size())
+      << "The symbol has " << arg_names.size() << " arguments but "
+      << arg_arrays.size() << " arrays are given";
+  for (size_t i = 0; i < arg_names.size(); ++i) {
+    arg_index_[arg_names[i]] = i;
+  }
+}
+
+size_t Executor::GetArgIndex(const std::string &name) const {
+  auto iter = arg_index_.find(name);
+  CHECK(!arg_index_.empty())
+      << "The executor was created from a handle without its symbol and "
+         "arguments";
+  CHECK(iter != arg_index_.end()) << "Cannot find argument " << name;
+  return iter->second;
+}
+
+void Executor::SetInput(const std::string &name, const NDArray &value) {
+  value.CopyTo(&arg_arrays[GetArgIndex(name)]);
+}
+
+void Executor::SetInput(const std::string &name, const mx_float *data,
+                        size_t size) {
+  arg_arrays[GetArgIndex(name)].SyncCopyFromCPU(data, size);
+}
+
+Executor *Executor::Reshape(
+    const std::map<std::string, std::vector<mx_uint> > &input_shapes,
+    bool partial_shaping, bool allow_up_sizing) {
+  CHECK(!arg_index_.empty()) << "Reshape needs an executor bound from a Symbol";
+  std::vector<std::vector<mx_uint> > in_shapes, aux_shapes, out_shapes;
+  symbol_.InferShape(input_shapes, &in_shapes, &aux_shapes, &out_shapes);
+  CHECK_EQ(in_shapes.size(), arg_arrays.size())
+      << "Reshape: input_shapes is insufficient to infer all the shapes";
+
+  const auto arg_names = symbol_.ListArguments();
+  std::vector<NDArray> new_arg_arrays, new_grad_arrays, new_aux_arrays;
+  for (size_t i = 0; i < arg_arrays.size(); ++i) {
+    bool allow_change =
+        partial_shaping || input_shapes.count(arg_names[i]) > 0;
+    new_arg_arrays.push_back(ReshapeArray(arg_arrays[i], in_shapes[i],
+                                          arg_names[i], allow_change,
+                                          allow_up_sizing));
+    if (grad_reqs_[i] == kNullOp) {
+      new_grad_arrays.push_back(grad_arrays[i]);
+    } else {
+      new_grad_arrays.push_back(ReshapeArray(grad_arrays[i], in_shapes[i],
+                                             arg_names[i], allow_change,
+                                             allow_up_sizing));
+    }
+  }
+  const auto aux_names = symbol_.ListAuxiliaryStates();
+  for (size_t i = 0; i < aux_arrays.size(); ++i) {
+    new_aux_arrays.push_back(ReshapeArray(aux_arrays[i], aux_shapes[i],
+                                          aux_names[i], partial_shaping,
+                                          allow_up_sizing));
+  }
+
+  return new Executor(symbol_, context_, new_arg_arrays, new_grad_arrays,
+                      grad_reqs_, new_aux_arrays, group_to_ctx_, this);
+}
+
+NDArray Executor::ReshapeArray(const NDArray &array,
+                               const std::vector<mx_uint> &new_shape,
+                               const std::string &name, bool allow_change,
+                               bool allow_up_sizing) {
+  Shape shape(new_shape);
+  if (array.GetShapeRef() == shape) {
+    return array;
+  }
+  CHECK(allow_change) << "Shape of unspecified array " << name
+                      << " changed, set partial_shaping to allow it";
+  if (shape.Size() > array.Size()) {
+    CHECK(allow_up_sizing) << "New shape of " << name
+                           << " is larger than the original, set "
+                              "allow_up_sizing to allocate a new array";
+    return NDArray(shape, array.GetContext(), false);
+  }
+  return array.Reshape(shape);
 }
 
 std::string Executor::DebugStr() {
@@ -82,9 +185,19 @@ std::string Executor::DebugStr() {
 void Executor::UpdateAll(Optimizer *opt, float lr, float wd,
                          int arg_update_begin, int arg_update_end) {
   arg_update_end = arg_update_end < 0 ? arg_arrays.size() - 1 : arg_update_end;
-  for (int i = arg_update_begin; i < arg_update_end; ++i) {
-    opt->Update(i, arg_arrays[i], grad_arrays[i], lr, wd);
+  int num_update = std::max(arg_update_end - arg_update_begin, 0);
+  if (update_indices_.size() != static_cast<size_t>(num_update) ||
+      (num_update > 0 && update_indices_[0] != arg_update_begin)) {
+    update_indices_.clear();
+    update_weights_.clear();
+    update_grads_.clear();
+    for (int i = arg_update_begin; i < arg_update_end; ++i) {
+      update_indices_.push_back(i);
+      update_weights_.push_back(arg_arrays[i]);
+      update_grads_.push_back(grad_arrays[i]);
+    }
   }
+  opt->Update(update_indices_, update_weights_, update_grads_, lr, wd);
 }
 }  // namespace cpp
 }  // namespace mxnet
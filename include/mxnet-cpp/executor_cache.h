@@ -0,0 +1,102 @@
+/*!
+*  Copyright (c) 2016 by Contributors
+* \file executor_cache.h
+* \brief cache of executors keyed by their input shapes
+*/
+
+#ifndef MXNETCPP_EXECUTOR_CACHE_H
+#define MXNETCPP_EXECUTOR_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "mxnet-cpp/base.h"
+#include "mxnet-cpp/executor.h"
+
+namespace mxnet {
+namespace cpp {
+
+/*!
+* \brief bounded LRU cache of executors keyed by their input shapes.
+*  All the cached executors are created by Executor::Reshape from one base
+*  executor, so they share its parameters and its memory pool. Bind the base
+*  executor with the largest shapes expected to keep the peak memory there.
+*
+*  Lookups are safe to call from several threads and do not take a lock
+*  when they hit. Since the cached executors share memory with each other,
+*  running two of them at the same time is still not allowed.
+*/
+class ExecutorCache {
+ public:
+  /*! \brief map of argument name to its shape, the key of the cache */
+  typedef std::map<std::string, std::vector<mx_uint> > ShapeMap;
+  /*!
+  * \brief construct an empty cache
+  * \param base the executor to share memory with, it is not owned by the
+  *  cache and should outlive it
+  * \param capacity the maximum number of executors kept in the cache
+  * \param allow_up_sizing whether a shape larger than the one of base is
+  *  allowed, see Executor::Reshape
+  */
+  explicit ExecutorCache(Executor *base, size_t capacity = 8,
+                         bool allow_up_sizing = false);
+  ~ExecutorCache();
+  /*!
+  * \brief get the executor bound with the given input shapes, create it if
+  *  it is not in the cache, evicting the least recently used one if full
+  * \param input_shapes map of argument name to the shape of the inputs
+  * \return the executor, it stays valid after being evicted as long as the
+  *  returned pointer is held
+  */
+  std::shared_ptr<Executor> Get(const ShapeMap &input_shapes);
+  /*! \brief drop all the cached executors */
+  void Clear();
+  /*! \return number of lookups served from the cache */
+  size_t GetHits() const { return hits_.load(); }
+  /*! \return number of lookups that had to create a new executor */
+  size_t GetMisses() const { return misses_.load(); }
+  /*! \return number of executors evicted from the cache */
+  size_t GetEvictions() const { return evictions_.load(); }
+
+ private:
+  ExecutorCache(const ExecutorCache &);
+  ExecutorCache &operator=(const ExecutorCache &);
+  /*!
+  * \brief a cached executor. Entries are immutable once published, except
+  *  for the recency stamp
+  */
+  struct Entry {
+    Entry(const ShapeMap &shapes, std::shared_ptr<Executor> exec)
+        : shapes(shapes), exec(exec), last_used(0) {}
+    ShapeMap shapes;
+    std::shared_ptr<Executor> exec;
+    std::atomic<uint64_t> last_used;
+  };
+  /*! \brief look for input_shapes in the slots, nullptr if not found */
+  std::shared_ptr<Executor> Find(const ShapeMap &input_shapes);
+  /*! \brief free the retired entries if no lookup may still read them */
+  void Reclaim();
+
+  Executor *base_;
+  size_t capacity_;
+  bool allow_up_sizing_;
+  /*! \brief the slots read by lookups without locking */
+  std::unique_ptr<std::atomic<Entry *>[]> slots_;
+  /*! \brief evicted entries waiting until no lookup is running */
+  std::vector<Entry *> retired_;
+  /*! \brief serializes the misses and the evictions */
+  std::mutex mutex_;
+  /*! \brief number of lookups currently reading the slots */
+  std::atomic<int> readers_;
+  std::atomic<uint64_t> clock_;
+  std::atomic<size_t> hits_, misses_, evictions_;
+};
+
+}  // namespace cpp
+}  // namespace mxnet
+
+#endif  // MXNETCPP_EXECUTOR_CACHE_H
@@ -0,0 +1,126 @@
+/*!
+ *  Copyright (c) 2016 by Contributors
+ * \file executor_cache.hpp
+ * \brief implementation of the executor cache
+ */
+
+#ifndef MXNETCPP_EXECUTOR_CACHE_HPP
+#define MXNETCPP_EXECUTOR_CACHE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "mxnet-cpp/executor_cache.h"
+
+namespace mxnet {
+namespace cpp {
+
+ExecutorCache::ExecutorCache(Executor *base, size_t capacity,
+                             bool allow_up_sizing)
+    : base_(base),
+      capacity_(capacity),
+      allow_up_sizing_(allow_up_sizing),
+      slots_(new std::atomic<Entry *>[capacity]),
+      readers_(0),
+      clock_(0),
+      hits_(0),
+      misses_(0),
+      evictions_(0) {
+  CHECK(base_ != nullptr);
+  CHECK_GT(capacity_, 0);
+  for (size_t i = 0; i < capacity_; ++i) {
+    slots_[i].store(nullptr);
+  }
+}
+
+ExecutorCache::~ExecutorCache() {
+  Clear();
+  // no lookup can be running any more
+  for (auto entry : retired_) {
+    delete entry;
+  }
+}
+
+std::shared_ptr<Executor> ExecutorCache::Find(const ShapeMap &input_shapes) {
+  for (size_t i = 0; i < capacity_; ++i) {
+    Entry *entry = slots_[i].load();
+    if (entry != nullptr && entry->shapes == input_shapes) {
+      entry->last_used.store(++clock_, std::memory_order_relaxed);
+      return entry->exec;
+    }
+  }
+  return nullptr;
+}
+
+std::shared_ptr<Executor> ExecutorCache::Get(const ShapeMap &input_shapes) {
+  // fast path, the retired entries are not freed while readers_ is non-zero
+  readers_.fetch_add(1);
+  auto exec = Find(input_shapes);
+  readers_.fetch_sub(1);
+  if (exec != nullptr) {
+    ++hits_;
+    return exec;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // another thread may have created it while we were waiting
+  exec = Find(input_shapes);
+  if (exec != nullptr) {
+    ++hits_;
+    return exec;
+  }
+  ++misses_;
+  exec.reset(base_->Reshape(input_shapes, false, allow_up_sizing_));
+
+  size_t victim = 0;
+  uint64_t oldest = UINT64_MAX;
+  for (size_t i = 0; i < capacity_; ++i) {
+    Entry *entry = slots_[i].load();
+    if (entry == nullptr) {
+      victim = i;
+      break;
+    }
+    uint64_t last_used = entry->last_used.load(std::memory_order_relaxed);
+    if (last_used < oldest) {
+      oldest = last_used;
+      victim = i;
+    }
+  }
+  Entry *entry = new Entry(input_shapes, exec);
+  entry->last_used.store(++clock_, std::memory_order_relaxed);
+  Entry *evicted = slots_[victim].exchange(entry);
+  if (evicted != nullptr) {
+    ++evictions_;
+    retired_.push_back(evicted);
+  }
+  Reclaim();
+  return exec;
+}
+
+void ExecutorCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < capacity_; ++i) {
+    Entry *entry = slots_[i].exchange(nullptr);
+    if (entry != nullptr) {
+      retired_.push_back(entry);
+    }
+  }
+  Reclaim();
+}
+
+void ExecutorCache::Reclaim() {
+  // a lookup that starts after this check can only see the new slot values
+  if (readers_.load() != 0) {
+    return;
+  }
+  for (auto entry : retired_) {
+    delete entry;
+  }
+  retired_.clear();
+}
+
+}  // namespace cpp
+}  // namespace mxnet
+
+#endif  // MXNETCPP_EXECUTOR_CACHE_HPP
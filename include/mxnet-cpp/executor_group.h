@@ -0,0 +1,122 @@
+/*!
+*  Copyright (c) 2016 by Contributors
+* \file executor_group.h
+* \brief data parallel execution of a symbol on several devices
+*/
+
+#ifndef MXNETCPP_EXECUTOR_GROUP_H
+#define MXNETCPP_EXECUTOR_GROUP_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mxnet-cpp/base.h"
+#include "mxnet-cpp/executor.h"
+#include "mxnet-cpp/kvstore.h"
+#include "mxnet-cpp/symbol.h"
+#include "mxnet-cpp/trainer.h"
+
+namespace mxnet {
+namespace cpp {
+
+/*!
+* \brief executors of one symbol on several devices, each running a part of
+*  every batch. The batch is split along its first dimension, the parameters
+*  are replicated on the devices and kept identical through a kvstore, which
+*  sums the gradients of all the devices and runs the optimizer.
+*
+*  Each CPU context, like Context::cpu(1), gets its own worker threads in
+*  the engine, so a group of CPU contexts uses several thread pools, for
+*  instance one per socket.
+*/
+class DataParallelExecutorGroup {
+ public:
+  /*!
+  * \param symbol the symbol to bind
+  * \param contexts the devices, the first one holds the reference values
+  *  of the parameters
+  * \param input_shapes map of the names of the inputs, like "data" and
+  *  "label", to their shape for a whole batch. Their gradients are not
+  *  computed, all the other arguments are trained
+  * \param kvstore the kvstore reducing the gradients, "local" or "device",
+  *  with an optimizer set by KVStore::SetOptimizer, or by SetOptimizer of
+  *  the group. With nullptr, the group is for inference only and no
+  *  gradient is allocated
+  * \param arg_params initial values of the parameters, the others are
+  *  sampled from a gaussian
+  * \param aux_params initial values of the auxiliary states
+  */
+  DataParallelExecutorGroup(
+      const Symbol &symbol, const std::vector<Context> &contexts,
+      const std::map<std::string, std::vector<mx_uint> > &input_shapes,
+      KVStore *kvstore,
+      const std::map<std::string, NDArray> &arg_params =
+          std::map<std::string, NDArray>(),
+      const std::map<std::string, NDArray> &aux_params =
+          std::map<std::string, NDArray>());
+  /*!
+  * \brief copy a batch into the input slots of the executors
+  * \param name name of the input
+  * \param batch the whole batch, on any context
+  */
+  void SetInput(const std::string &name, const NDArray &batch);
+  /*!
+  * \brief copy a batch from continugous CPU memory
+  * \param name name of the input
+  * \param data the whole batch
+  */
+  void SetInput(const std::string &name, const mx_float *data);
+  /*! \brief run Forward on all the devices */
+  void Forward(bool is_train);
+  /*!
+  * \brief run Backward on all the devices and queue the update of the
+  *  parameters, see KVStoreTrainer::Backward
+  */
+  void Backward();
+  /*!
+  * \brief update the parameters with optimizer once the kvstore has summed
+  *  the gradients, see KVStoreTrainer::SetOptimizer
+  * \param optimizer the optimizer
+  */
+  void SetOptimizer(std::unique_ptr<Optimizer> optimizer);
+  /*!
+  * \brief copy an output of all the devices into an array of the whole batch
+  * \param index index of the output
+  * \param out array of the output shape for the whole batch
+  */
+  void CopyOutputTo(size_t index, NDArray *out) const;
+  /*!
+  * \brief copy the parameters to arrays on a context, the auxiliary states
+  *  are averaged over the devices
+  * \param context context of the copies
+  * \param arg_params map of the names of the parameters to their values
+  * \param aux_params map of the names of the auxiliary states to their
+  *  values
+  */
+  void GetParams(const Context &context,
+                 std::map<std::string, NDArray> *arg_params,
+                 std::map<std::string, NDArray> *aux_params) const;
+  /*! \return the executors, one per device */
+  std::vector<Executor *> GetExecutors() const;
+  /*! \return the batch size */
+  mx_uint GetBatchSize() const { return offsets_.back(); }
+
+ private:
+  DataParallelExecutorGroup(const DataParallelExecutorGroup &);
+  DataParallelExecutorGroup &operator=(const DataParallelExecutorGroup &);
+  Symbol symbol_;
+  std::vector<std::unique_ptr<Executor> > execs_;
+  /*! \brief the part of device i is [offsets_[i], offsets_[i + 1]) */
+  std::vector<mx_uint> offsets_;
+  /*! \brief number of elements of one example of each input */
+  std::map<std::string, size_t> example_sizes_;
+  /*! \brief positions of the trained arguments */
+  std::vector<int> param_indices_;
+  std::unique_ptr<KVStoreTrainer> trainer_;
+};
+
+}  // namespace cpp
+}  // namespace mxnet
+
+#endif  // MXNETCPP_EXECUTOR_GROUP_H
@@ -0,0 +1,175 @@
+/*!
+ *  Copyright (c) 2016 by Contributors
+ * \file executor_group.hpp
+ * \brief implementation of the data parallel executor group
+ */
+
+#ifndef MXNETCPP_EXECUTOR_GROUP_HPP
+#define MXNETCPP_EXECUTOR_GROUP_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include "mxnet-cpp/executor_group.h"
+
+namespace mxnet {
+namespace cpp {
+
+DataParallelExecutorGroup::DataParallelExecutorGroup(
+    const Symbol &symbol, const std::vector<Context> &contexts,
+    const std::map<std::string, std::vector<mx_uint> > &input_shapes,
+    KVStore *kvstore, const std::map<std::string, NDArray> &arg_params,
+    const std::map<std::string, NDArray> &aux_params)
+    : symbol_(symbol) {
+  CHECK(!contexts.empty());
+  CHECK(!input_shapes.empty());
+  mx_uint batch_size = input_shapes.begin()->second.at(0);
+  for (const auto &input : input_shapes) {
+    CHECK_EQ(input.second.at(0), batch_size)
+        << "the inputs should have the same batch size, " << input.first;
+    size_t example_size = 1;
+    for (size_t i = 1; i < input.second.size(); ++i) {
+      example_size *= input.second[i];
+    }
+    example_sizes_[input.first] = example_size;
+  }
+  size_t num_devices = contexts.size();
+  CHECK_GE(batch_size, num_devices) << "the batch is smaller than the devices";
+  for (size_t i = 0; i <= num_devices; ++i) {
+    offsets_.push_back(batch_size * i / num_devices);
+  }
+
+  // no gradient is allocated for the inputs, nor for anything without
+  // kvstore
+  const auto arg_names = symbol_.ListArguments();
+  std::map<std::string, NDArray> no_grads;
+  std::map<std::string, OpReqType> grad_reqs;
+  for (const auto &name : arg_names) {
+    if (kvstore == nullptr || input_shapes.count(name) > 0) {
+      no_grads[name] = NDArray();
+      grad_reqs[name] = kNullOp;
+    }
+  }
+  for (size_t i = 0; i < num_devices; ++i) {
+    std::map<std::string, NDArray> inputs;
+    for (const auto &input : input_shapes) {
+      std::vector<mx_uint> shape = input.second;
+      shape[0] = offsets_[i + 1] - offsets_[i];
+      inputs[input.first] = NDArray(Shape(shape), contexts[i], false);
+    }
+    execs_.emplace_back(
+        symbol_.SimpleBind(contexts[i], inputs, no_grads, grad_reqs));
+  }
+
+  // replicate the parameters of the first device, or the given ones
+  for (size_t j = 0; j < arg_names.size(); ++j) {
+    if (input_shapes.count(arg_names[j]) > 0) continue;
+    param_indices_.push_back(j);
+    auto it = arg_params.find(arg_names[j]);
+    const NDArray &value =
+        it != arg_params.end() ? it->second : execs_[0]->arg_arrays[j];
+    for (size_t i = it != arg_params.end() ? 0 : 1; i < num_devices; ++i) {
+      value.CopyTo(&execs_[i]->arg_arrays[j]);
+    }
+  }
+  const auto aux_names = symbol_.ListAuxiliaryStates();
+  for (size_t j = 0; j < aux_names.size(); ++j) {
+    auto it = aux_params.find(aux_names[j]);
+    const NDArray &value =
+        it != aux_params.end() ? it->second : execs_[0]->aux_arrays[j];
+    for (size_t i = it != aux_params.end() ? 0 : 1; i < num_devices; ++i) {
+      value.CopyTo(&execs_[i]->aux_arrays[j]);
+    }
+  }
+
+  if (kvstore != nullptr) {
+    trainer_.reset(
+        new KVStoreTrainer(GetExecutors(), kvstore, param_indices_));
+    trainer_->Init();
+  }
+}
+
+void DataParallelExecutorGroup::SetInput(const std::string &name,
+                                         const NDArray &batch) {
+  CHECK_EQ(batch.GetShapeRef()[0], GetBatchSize());
+  for (size_t i = 0; i < execs_.size(); ++i) {
+    execs_[i]->SetInput(name, batch.Slice(offsets_[i], offsets_[i + 1]));
+  }
+}
+
+void DataParallelExecutorGroup::SetInput(const std::string &name,
+                                         const mx_float *data) {
+  auto it = example_sizes_.find(name);
+  CHECK(it != example_sizes_.end()) << name << " is not an input";
+  for (size_t i = 0; i < execs_.size(); ++i) {
+    execs_[i]->SetInput(name, data + offsets_[i] * it->second,
+                        (offsets_[i + 1] - offsets_[i]) * it->second);
+  }
+}
+
+void DataParallelExecutorGroup::Forward(bool is_train) {
+  // the engine runs the devices in parallel
+  for (auto &exec : execs_) {
+    exec->Forward(is_train);
+  }
+}
+
+void DataParallelExecutorGroup::Backward() {
+  CHECK(trainer_ != nullptr) << "the group is bound for inference only";
+  trainer_->Backward();
+}
+
+void DataParallelExecutorGroup::SetOptimizer(
+    std::unique_ptr<Optimizer> optimizer) {
+  CHECK(trainer_ != nullptr) << "the group is bound for inference only";
+  trainer_->SetOptimizer(std::move(optimizer));
+}
+
+void DataParallelExecutorGroup::CopyOutputTo(size_t index,
+                                             NDArray *out) const {
+  CHECK_EQ(out->GetShapeRef()[0], GetBatchSize());
+  for (size_t i = 0; i < execs_.size(); ++i) {
+    NDArray part = out->Slice(offsets_[i], offsets_[i + 1]);
+    execs_[i]->outputs.at(index).CopyTo(&part);
+  }
+}
+
+void DataParallelExecutorGroup::GetParams(
+    const Context &context, std::map<std::string, NDArray> *arg_params,
+    std::map<std::string, NDArray> *aux_params) const {
+  const auto arg_names = symbol_.ListArguments();
+  for (int j : param_indices_) {
+    const NDArray &value = execs_[0]->arg_arrays[j];
+    NDArray copy(value.GetShapeRef(), context, false);
+    value.CopyTo(&copy);
+    (*arg_params)[arg_names[j]] = copy;
+  }
+  const auto aux_names = symbol_.ListAuxiliaryStates();
+  for (size_t j = 0; j < aux_names.size(); ++j) {
+    const Shape &shape = execs_[0]->aux_arrays[j].GetShapeRef();
+    NDArray sum(shape, context, false);
+    execs_[0]->aux_arrays[j].CopyTo(&sum);
+    for (size_t i = 1; i < execs_.size(); ++i) {
+      NDArray copy(shape, context, false);
+      execs_[i]->aux_arrays[j].CopyTo(&copy);
+      sum += copy;
+    }
+    if (execs_.size() > 1) {
+      sum /= execs_.size();
+    }
+    (*aux_params)[aux_names[j]] = sum;
+  }
+}
+
+std::vector<Executor *> DataParallelExecutorGroup::GetExecutors() const {
+  std::vector<Executor *> ret;
+  for (const auto &exec : execs_) {
+    ret.push_back(exec.get());
+  }
+  return ret;
+}
+
+}  // namespace cpp
+}  // namespace mxnet
+
+#endif  // MXNETCPP_EXECUTOR_GROUP_HPP
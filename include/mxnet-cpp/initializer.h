@@ -55,7 +55,7 @@ class Initializer {
 
  protected:
   virtual void InitBilinear(NDArray* arr) {
-    Shape shape(arr->GetShape());
+    const Shape &shape = arr->GetShapeRef();
     std::vector<float> weight(shape.Size(), 0);
     int f = std::ceil(shape[3] / 2.0);
     float c = (2 * f - 1 - f % 2) / (2. * f);
@@ -93,7 +93,7 @@ class Xavier : public Initializer {
 
  protected:
   virtual void InitWeight(NDArray* arr) {
-    Shape shape(arr->GetShape());
+    const Shape &shape = arr->GetShapeRef();
     float hw_scale = 1.0f;
     if (shape.ndim() > 2) {
       for (size_t i = 2; i < shape.ndim(); ++i) {
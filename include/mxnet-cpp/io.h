@@ -7,8 +7,17 @@
 #ifndef MXNETCPP_IO_H
 #define MXNETCPP_IO_H
 
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <string>
+#include <thread>
 #include <vector>
 #include <sstream>
 #include "mxnet-cpp/base.h"
@@ -121,6 +130,450 @@ class MXDataIter : public DataIter {
   std::shared_ptr<MXDataIterBlob> blob_ptr_;
   static MXDataIterMap *mxdataiter_map_;
 };
+
+/*!
+* \brief DataIter that prefetches the batches of another DataIter.
+*  A background thread calls Next on the wrapped iterator and copies each
+*  batch to the target context, into a ring of arrays that are allocated
+*  with the first batches and reused afterwards. The batches handed out are
+*  ready to be read, so loading and copying the next batches overlaps with
+*  the computation on the current one. A batch stays valid until the next
+*  call to Next. An exception of the wrapped iterator is rethrown by Next
+*  once the batches fetched before it are consumed.
+*/
+class PrefetchingIter : public DataIter {
+ public:
+  /*!
+  * \brief construct a prefetching iterator, nothing is fetched until the
+  *  first call to Next
+  * \param base the iterator to prefetch from, it is not owned and should
+  *  not be used by anyone else while this one is alive
+  * \param context the context to copy the batches to
+  * \param depth number of batches prepared in advance
+  */
+  PrefetchingIter(DataIter *base, const Context &context, int depth = 2);
+  ~PrefetchingIter();
+  void BeforeFirst();
+  bool Next();
+  NDArray GetData();
+  NDArray GetLabel();
+  int GetPadNum();
+  std::vector<int> GetIndex();
+
+ private:
+  PrefetchingIter(const PrefetchingIter &);
+  PrefetchingIter &operator=(const PrefetchingIter &);
+  /*! \brief the loop of the background thread */
+  void Run();
+  /*! \brief fetch the batches until the end or Stop, may throw */
+  void Fetch();
+  /*! \brief stop the background thread and drop the prefetched batches */
+  void Stop();
+  DataIter *base_;
+  Context context_;
+  /*! \brief ring of batches on context_ */
+  std::vector<DataBatch> slots_;
+  /*! \brief number of batches fetched since BeforeFirst */
+  size_t produced_;
+  /*! \brief number of batches released by the consumer since BeforeFirst */
+  size_t consumed_;
+  /*! \brief whether the consumer holds the slot of consumed_ */
+  bool holding_;
+  bool end_of_data_;
+  bool stop_;
+  bool running_;
+  /*! \brief the exception of the background thread, rethrown by Next */
+  std::exception_ptr error_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+};
+/*!
+* \brief DataIter over in-memory NDArrays.
+*  Each batch is a Slice of the data and label arrays, so no example is
+*  copied. Shuffling permutes the order in which the batches are visited
+*  every epoch, the examples within a batch stay together. The last
+*  incomplete batch is either discarded or completed with examples from the
+*  beginning, in which case GetPadNum tells how many were added.
+*/
+class NDArrayIter : public DataIter {
+ public:
+  /*!
+  * \brief construct the iterator
+  * \param data the data, its first dimension indexes the examples
+  * \param label the labels, with one entry per example
+  * \param batch_size number of examples in a batch
+  * \param shuffle whether to visit the batches in a random order
+  * \param discard_last whether to discard the last incomplete batch
+  */
+  NDArrayIter(const NDArray &data, const NDArray &label, int batch_size,
+              bool shuffle = false, bool discard_last = false);
+  void BeforeFirst();
+  bool Next();
+  NDArray GetData();
+  NDArray GetLabel();
+  int GetPadNum();
+  std::vector<int> GetIndex();
+
+ private:
+  NDArray data_, label_;
+  /*! \brief buffers of the last incomplete batch, which needs a copy */
+  NDArray pad_data_, pad_label_;
+  mx_uint num_examples_;
+  mx_uint batch_size_;
+  bool shuffle_;
+  /*! \brief the batches in the order of the current epoch */
+  std::vector<mx_uint> order_;
+  size_t cursor_;
+  mx_uint begin_;
+  int pad_num_;
+  std::mt19937 rng_;
+};
+
+/*!
+* \brief DataIter over a CSV file of numbers, one example per line.
+*  The file is read at once and parsed in chunks by several threads
+*  directly into a CPU NDArray, then served like NDArrayIter does.
+*/
+class CSVIter : public DataIter {
+ public:
+  /*!
+  * \brief construct the iterator, the file is parsed at the first call to
+  *  BeforeFirst or Next, so the Set functions can be chained before
+  * \param file_name path of the CSV file
+  * \param batch_size number of examples in a batch
+  */
+  CSVIter(const std::string &file_name, int batch_size);
+  /*!
+  * \param label_column the column holding the label, -1 if there is no
+  *  label column, in which case the labels are all 0
+  * \return reference of self
+  */
+  CSVIter &SetLabelColumn(int label_column);
+  /*!
+  * \param has_header whether the first line is a header to skip
+  * \return reference of self
+  */
+  CSVIter &SetHeader(bool has_header);
+  /*!
+  * \param data_shape the shape of one example, e.g. Shape(1, 28, 28), by
+  *  default the examples are flat
+  * \return reference of self
+  */
+  CSVIter &SetDataShape(const Shape &data_shape);
+  /*!
+  * \param shuffle whether to visit the batches in a random order
+  * \return reference of self
+  */
+  CSVIter &SetShuffle(bool shuffle);
+  /*!
+  * \param num_threads number of parsing threads, 0 to use all the cores
+  * \return reference of self
+  */
+  CSVIter &SetNumThreads(int num_threads);
+  void BeforeFirst();
+  bool Next();
+  NDArray GetData();
+  NDArray GetLabel();
+  int GetPadNum();
+  std::vector<int> GetIndex();
+  /*!
+  * \brief parse a CSV file of numbers into host memory
+  * \param file_name path of the CSV file
+  * \param label_column the column holding the label, -1 if none
+  * \param has_header whether the first line is a header to skip
+  * \param data filled with the other columns, row by row
+  * \param label filled with the labels, left untouched if label_column is -1
+  * \param num_threads number of parsing threads, 0 to use all the cores
+  * \return number of examples
+  */
+  static size_t Parse(const std::string &file_name, int label_column,
+                      bool has_header, std::vector<mx_float> *data,
+                      std::vector<mx_float> *label, int num_threads = 0);
+
+ private:
+  /*! \brief parse the file and create the NDArrayIter serving it */
+  void Load();
+  /*!
+  * \brief parse the content of a file with several threads
+  * \param text the content of the file
+  * \param text_begin where the first example starts in text
+  * \param label_column the column holding the label, -1 if none
+  * \param num_threads number of parsing threads, 0 to use all the cores
+  * \param alloc called with the number of rows and of columns, returns the
+  *  pair of pointers where the data and the labels are written
+  * \return number of examples
+  */
+  template <typename Alloc>
+  static size_t ParseText(const std::string &text, size_t text_begin,
+                          int label_column, int num_threads, Alloc alloc);
+  std::string file_name_;
+  int batch_size_;
+  int label_column_;
+  bool has_header_;
+  Shape data_shape_;
+  bool shuffle_;
+  int num_threads_;
+  std::unique_ptr<NDArrayIter> iter_;
+};
+/*!
+* \brief writer of the binary dataset format read by MmapIter.
+*  All the integers are little endian, the file is laid out as follows:
+*    uint32 magic, kMagic
+*    uint32 version, kVersion
+*    uint32 dtype, 0 for float32, the only type supported
+*    uint32 ndim of a data record, followed by uint32 dims
+*    uint32 ndim of a label record, followed by uint32 dims, 0 for a scalar
+*    uint64 number of records
+*    zero padding up to a multiple of kAlignment bytes
+*    the data of all the records, one after the other
+*    the labels of all the records, one after the other
+*  Since the data and the labels of consecutive records are contiguous, a
+*  batch is read with a single copy of each.
+*/
+class MmapWriter {
+ public:
+  /*! \brief first field of the file */
+  static const uint32_t kMagic = 0x50414d4d;
+  /*! \brief version of the format */
+  static const uint32_t kVersion = 1;
+  /*! \brief the data section starts at a multiple of this */
+  static const size_t kAlignment = 64;
+  /*!
+  * \brief create the file, overwriting an existing one
+  * \param file_name path of the file
+  * \param data_shape shape of the data of one record
+  * \param label_shape shape of the label of one record, scalar by default
+  */
+  MmapWriter(const std::string &file_name, const Shape &data_shape,
+             const Shape &label_shape = Shape());
+  /*! \brief Close the file, logging the errors instead of throwing */
+  ~MmapWriter();
+  /*!
+  * \brief append records
+  * \param data the data of the records, one after the other
+  * \param label the labels of the records, nullptr to write zeros
+  * \param num_records number of records
+  */
+  void Write(const mx_float *data, const mx_float *label,
+             size_t num_records = 1);
+  /*!
+  * \brief write the labels and the number of records, it is called by the
+  *  destructor if not before; call it to get the write errors as exceptions
+  */
+  void Close();
+  /*!
+  * \return size in bytes of the header for the given shapes, including the
+  *  padding
+  */
+  static size_t HeaderSize(const Shape &data_shape, const Shape &label_shape);
+
+ private:
+  MmapWriter(const MmapWriter &);
+  MmapWriter &operator=(const MmapWriter &);
+  std::ofstream out_;
+  Shape data_shape_, label_shape_;
+  /*! \brief the labels are written after all the data */
+  std::vector<mx_float> labels_;
+  uint64_t num_records_;
+  bool closed_;
+};
+
+/*!
+* \brief DataIter over a file written by MmapWriter.
+*  The file is mapped in memory instead of being read, so opening it is
+*  instant whatever its size, and the records are only kept in the page
+*  cache, shared with other processes and dropped by the kernel under
+*  memory pressure. Each batch is copied to the target context straight
+*  from the mapped pages, while the kernel is asked to read ahead the pages
+*  of the next batch. A batch stays valid until the next call to Next.
+*  The last incomplete batch is handled like NDArrayIter does.
+*/
+class MmapIter : public DataIter {
+ public:
+  /*!
+  * \brief map the file in memory
+  * \param file_name path of a file written by MmapWriter
+  * \param batch_size number of examples in a batch
+  * \param context where the batches are copied to
+  * \param shuffle whether to visit the batches in a random order
+  * \param discard_last whether to discard the last incomplete batch
+  */
+  MmapIter(const std::string &file_name, int batch_size,
+           const Context &context = Context::cpu(), bool shuffle = false,
+           bool discard_last = false);
+  /*! \brief unmap the file */
+  ~MmapIter();
+  void BeforeFirst();
+  bool Next();
+  NDArray GetData();
+  NDArray GetLabel();
+  int GetPadNum();
+  std::vector<int> GetIndex();
+  /*! \return number of records in the file */
+  size_t GetNumExamples() const { return num_examples_; }
+
+ private:
+  MmapIter(const MmapIter &);
+  MmapIter &operator=(const MmapIter &);
+  /*! \brief copy count records from first to the position dst of the batch */
+  void CopyRecords(size_t first, mx_uint count, mx_uint dst);
+  /*! \brief ask the kernel to read the records of a batch in advance */
+  void WillNeed(size_t first) const;
+  const char *base_;
+  size_t file_size_;
+  size_t num_examples_;
+  /*! \brief number of elements of a record */
+  size_t data_stride_, label_stride_;
+  size_t data_offset_, label_offset_;
+  mx_uint batch_size_;
+  bool shuffle_;
+  std::vector<mx_uint> order_;
+  size_t cursor_;
+  mx_uint begin_;
+  int pad_num_;
+  NDArray data_, label_;
+  std::mt19937 rng_;
+};
+/*!
+* \brief writer of a RecordIO file, a sequence of binary records
+*/
+class RecordIOWriter {
+ public:
+  /*!
+  * \brief create the file, overwriting an existing one
+  * \param uri path of the file
+  */
+  explicit RecordIOWriter(const std::string &uri);
+  /*! \brief flush and close the file */
+  ~RecordIOWriter();
+  /*!
+  * \brief append a record
+  * \param buf the content of the record
+  * \param size size of the record in bytes
+  */
+  void WriteRecord(const char *buf, size_t size);
+  /*!
+  * \brief append a record
+  * \param record the content of the record
+  */
+  void WriteRecord(const std::string &record) {
+    WriteRecord(record.data(), record.size());
+  }
+
+ private:
+  RecordIOWriter(const RecordIOWriter &);
+  RecordIOWriter &operator=(const RecordIOWriter &);
+  RecordIOHandle handle_;
+};
+
+/*!
+* \brief sequential reader of a RecordIO file
+*/
+class RecordIOReader {
+ public:
+  /*!
+  * \brief open the file
+  * \param uri path of the file
+  */
+  explicit RecordIOReader(const std::string &uri);
+  /*! \brief close the file */
+  ~RecordIOReader();
+  /*!
+  * \brief read the next record without copying it
+  * \param buf set to the content of the record, valid until the next read
+  * \param size set to the size of the record in bytes
+  * \return false at the end of the file
+  */
+  bool ReadRecord(const char **buf, size_t *size);
+  /*!
+  * \brief read the next record
+  * \param record set to the content of the record
+  * \return false at the end of the file
+  */
+  bool ReadRecord(std::string *record);
+
+ private:
+  RecordIOReader(const RecordIOReader &);
+  RecordIOReader &operator=(const RecordIOReader &);
+  RecordIOHandle handle_;
+};
+
+/*!
+* \brief DataIter over a RecordIO file holding one example per record.
+*  The records of a batch are read sequentially, then decoded in parallel
+*  by a pool of OpenMP threads into a host buffer which is copied to the
+*  batch arrays at once. The batches are on the CPU, wrap the iterator in a
+*  PrefetchingIter to load them in the background and copy them to a GPU.
+*  The last incomplete batch is completed with the first examples, and
+*  GetPadNum tells how many were added.
+*/
+class RecordIOIter : public DataIter {
+ public:
+  /*!
+  * \brief function decoding a record into the buffers of one example,
+  *  called concurrently from several threads
+  * \param buf the content of the record
+  * \param size size of the record in bytes
+  * \param data where to write the data, of data_shape
+  * \param label where to write the label, of label_shape
+  */
+  typedef std::function<void(const char *buf, size_t size, mx_float *data,
+                             mx_float *label)> Decoder;
+  /*!
+  * \brief open the file
+  * \param uri path of the file
+  * \param batch_size number of examples in a batch
+  * \param data_shape shape of the data of one example
+  * \param label_shape shape of the label of one example, scalar by default
+  * \param decoder the decoder of the records, by default the format written
+  *  by EncodeRecord
+  * \param num_threads number of decoding threads, 0 to use all the cores
+  */
+  RecordIOIter(const std::string &uri, int batch_size, const Shape &data_shape,
+               const Shape &label_shape = Shape(),
+               Decoder decoder = Decoder(), int num_threads = 0);
+  void BeforeFirst();
+  bool Next();
+  NDArray GetData();
+  NDArray GetLabel();
+  int GetPadNum();
+  std::vector<int> GetIndex();
+  /*!
+  * \brief encode an example in the default record format, the raw float32
+  *  label followed by the raw float32 data
+  * \param data the data of the example
+  * \param data_size number of elements of data
+  * \param label the label of the example
+  * \param label_size number of elements of label
+  * \return the record
+  */
+  static std::string EncodeRecord(const mx_float *data, size_t data_size,
+                                  const mx_float *label, size_t label_size);
+
+ private:
+  std::string uri_;
+  mx_uint batch_size_;
+  size_t data_size_, label_size_;
+  Decoder decoder_;
+  int num_threads_;
+  std::unique_ptr<RecordIOReader> reader_;
+  /*! \brief the records of the current batch, their capacity is reused */
+  std::vector<std::string> records_;
+  /*! \brief the decoded batch, before being copied to the arrays */
+  std::vector<mx_float> host_data_, host_label_;
+  /*! \brief the decoded first batch, to complete the last one */
+  std::vector<mx_float> first_data_, first_label_;
+  NDArray data_, label_;
+  /*! \brief number of records read in the epoch */
+  size_t num_read_;
+  /*! \brief index in the file of the first record of the batch */
+  size_t record_begin_;
+  /*! \brief number of examples in the first batch */
+  mx_uint first_num_;
+  int pad_num_;
+  bool end_of_data_;
+};
 }  // namespace cpp
 }  // namespace mxnet
 
@@ -7,9 +7,23 @@
 #ifndef MXNETCPP_IO_HPP
 #define MXNETCPP_IO_HPP
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
 #include <string>
+#include <utility>
 #include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "mxnet-cpp/io.h"
+#include "mxnet-cpp/ndarray_view.h"
 
 namespace mxnet {
 namespace cpp {
@@ -80,8 +94,963 @@ MXDataIter MXDataIter::CreateDataIter() {
 
 // MXDataIter MNIst
 
+PrefetchingIter::PrefetchingIter(DataIter *base, const Context &context,
+                                 int depth)
+    : base_(base),
+      context_(context),
+      slots_(depth + 1),
+      produced_(0),
+      consumed_(0),
+      holding_(false),
+      end_of_data_(false),
+      stop_(false),
+      running_(false) {
+  CHECK(base_ != nullptr);
+  CHECK_GT(depth, 0);
+}
+
+PrefetchingIter::~PrefetchingIter() { Stop(); }
+
+void PrefetchingIter::Run() {
+  try {
+    Fetch();
+  } catch (...) {
+    // an exception escaping the thread would terminate the process
+    std::lock_guard<std::mutex> lock(mutex_);
+    error_ = std::current_exception();
+    end_of_data_ = true;
+    cond_.notify_all();
+  }
+}
+
+void PrefetchingIter::Fetch() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      // one slot may be held by the consumer, the others can be filled
+      cond_.wait(lock, [this] {
+        return stop_ || produced_ - consumed_ < slots_.size();
+      });
+      if (stop_) return;
+    }
+    if (!base_->Next()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      end_of_data_ = true;
+      cond_.notify_all();
+      return;
+    }
+    DataBatch &slot = slots_[produced_ % slots_.size()];
+    NDArray data = base_->GetData();
+    NDArray label = base_->GetLabel();
+    if (slot.data.GetShapeRef() != data.GetShapeRef()) {
+      slot.data = NDArray(data.GetShapeRef(), context_, false);
+    }
+    if (slot.label.GetShapeRef() != label.GetShapeRef()) {
+      slot.label = NDArray(label.GetShapeRef(), context_, false);
+    }
+    data.CopyTo(&slot.data);
+    label.CopyTo(&slot.label);
+    slot.pad_num = base_->GetPadNum();
+    slot.index = base_->GetIndex();
+    // the base iterator may overwrite its arrays in the next call to Next
+    slot.data.WaitToRead();
+    slot.label.WaitToRead();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++produced_;
+      cond_.notify_all();
+    }
+  }
+}
+
+void PrefetchingIter::Stop() {
+  if (!running_) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+    cond_.notify_all();
+  }
+  thread_.join();
+  running_ = false;
+}
+
+void PrefetchingIter::BeforeFirst() {
+  Stop();
+  base_->BeforeFirst();
+  produced_ = 0;
+  consumed_ = 0;
+  holding_ = false;
+  end_of_data_ = false;
+  stop_ = false;
+  error_ = nullptr;
+}
+
+bool PrefetchingIter::Next() {
+  if (!running_ && !end_of_data_) {
+    thread_ = std::thread(&PrefetchingIter::Run, this);
+    running_ = true;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (holding_) {
+    ++consumed_;
+    holding_ = false;
+    cond_.notify_all();
+  }
+  cond_.wait(lock, [this] { return produced_ > consumed_ || end_of_data_; });
+  holding_ = produced_ > consumed_;
+  // the batches fetched before the failure are returned first
+  if (!holding_ && error_) {
+    std::exception_ptr error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+  return holding_;
+}
+
+NDArray PrefetchingIter::GetData() {
+  CHECK(holding_) << "Next should return true before accessing the batch";
+  return slots_[consumed_ % slots_.size()].data;
+}
+
+NDArray PrefetchingIter::GetLabel() {
+  CHECK(holding_) << "Next should return true before accessing the batch";
+  return slots_[consumed_ % slots_.size()].label;
+}
+
+int PrefetchingIter::GetPadNum() {
+  CHECK(holding_) << "Next should return true before accessing the batch";
+  return slots_[consumed_ % slots_.size()].pad_num;
+}
+
+std::vector<int> PrefetchingIter::GetIndex() {
+  CHECK(holding_) << "Next should return true before accessing the batch";
+  return slots_[consumed_ % slots_.size()].index;
+}
+
+NDArrayIter::NDArrayIter(const NDArray &data, const NDArray &label,
+                         int batch_size, bool shuffle, bool discard_last)
+    : data_(data),
+      label_(label),
+      num_examples_(data.GetShapeRef()[0]),
+      batch_size_(batch_size),
+      shuffle_(shuffle),
+      cursor_(0),
+      begin_(0),
+      pad_num_(0) {
+  CHECK_GT(batch_size, 0);
+  CHECK_EQ(label_.GetShapeRef()[0], num_examples_)
+      << "data and label have a different number of examples";
+  CHECK_LE(batch_size_, num_examples_)
+      << "there are fewer examples than batch_size";
+  mx_uint num_batch = discard_last
+                          ? num_examples_ / batch_size_
+                          : (num_examples_ + batch_size_ - 1) / batch_size_;
+  for (mx_uint i = 0; i < num_batch; ++i) {
+    order_.push_back(i);
+  }
+  if (!discard_last && num_examples_ % batch_size_ != 0) {
+    Shape shape = data_.GetShapeRef();
+    shape[0] = batch_size_;
+    pad_data_ = NDArray(shape, data_.GetContext(), false);
+    shape = label_.GetShapeRef();
+    shape[0] = batch_size_;
+    pad_label_ = NDArray(shape, label_.GetContext(), false);
+  }
+}
+
+void NDArrayIter::BeforeFirst() {
+  cursor_ = 0;
+  pad_num_ = 0;
+  if (shuffle_) {
+    std::shuffle(order_.begin(), order_.end(), rng_);
+  }
+}
+
+bool NDArrayIter::Next() {
+  if (cursor_ >= order_.size()) return false;
+  begin_ = order_[cursor_++] * batch_size_;
+  mx_uint end = begin_ + batch_size_;
+  pad_num_ = end > num_examples_ ? end - num_examples_ : 0;
+  if (pad_num_ > 0) {
+    // the only batch which is not a slice, wrap around to the beginning
+    mx_uint rest = num_examples_ - begin_;
+    NDArray data_head = pad_data_.Slice(0, rest);
+    NDArray data_tail = pad_data_.Slice(rest, batch_size_);
+    NDArray label_head = pad_label_.Slice(0, rest);
+    NDArray label_tail = pad_label_.Slice(rest, batch_size_);
+    data_.Slice(begin_, num_examples_).CopyTo(&data_head);
+    data_.Slice(0, pad_num_).CopyTo(&data_tail);
+    label_.Slice(begin_, num_examples_).CopyTo(&label_head);
+    label_.Slice(0, pad_num_).CopyTo(&label_tail);
+  }
+  return true;
+}
+
+NDArray NDArrayIter::GetData() {
+  return pad_num_ > 0 ? pad_data_ : data_.Slice(begin_, begin_ + batch_size_);
+}
+
+NDArray NDArrayIter::GetLabel() {
+  return pad_num_ > 0 ? pad_label_
+                      : label_.Slice(begin_, begin_ + batch_size_);
+}
+
+int NDArrayIter::GetPadNum() { return pad_num_; }
+
+std::vector<int> NDArrayIter::GetIndex() {
+  std::vector<int> index(batch_size_);
+  for (mx_uint i = 0; i < batch_size_; ++i) {
+    index[i] = (begin_ + i) % num_examples_;
+  }
+  return index;
+}
+
+namespace private_ {
+/*!
+* \brief parse a decimal number, faster than strtof since it neither
+*  depends on the locale nor needs a null terminated string
+* \param p where the number starts, blanks are skipped
+* \param end end of the line
+* \param out the parsed value
+* \return where the number ends, p if there is no number
+*/
+inline const char *ParseFloat(const char *p, const char *end, mx_float *out) {
+  static const double kPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+  const char *start = p;
+  while (p != end && (*p == ' ' || *p == '\t')) ++p;
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+  // digits beyond what the mantissa holds only change the exponent
+  const uint64_t kMaxMantissa = 100000000000000000ULL;
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  bool has_digit = false;
+  for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+    has_digit = true;
+    if (mantissa < kMaxMantissa) {
+      mantissa = mantissa * 10 + (*p - '0');
+    } else {
+      ++exponent;
+    }
+  }
+  if (p != end && *p == '.') {
+    for (++p; p != end && *p >= '0' && *p <= '9'; ++p) {
+      has_digit = true;
+      if (mantissa < kMaxMantissa) {
+        mantissa = mantissa * 10 + (*p - '0');
+        --exponent;
+      }
+    }
+  }
+  if (!has_digit) return start;
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    bool negative_exponent = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+      negative_exponent = *p == '-';
+      ++p;
+    }
+    int e = 0;
+    for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+      if (e < 10000) e = e * 10 + (*p - '0');
+    }
+    exponent += negative_exponent ? -e : e;
+  }
+  double value = static_cast<double>(mantissa);
+  if (exponent < -22 || exponent > 22) {
+    value *= std::pow(10.0, exponent);
+  } else if (exponent < 0) {
+    value /= kPow10[-exponent];
+  } else {
+    value *= kPow10[exponent];
+  }
+  *out = static_cast<mx_float>(negative ? -value : value);
+  return p;
+}
+
+/*! \return end of the line starting at p, without the line break */
+inline const char *LineEnd(const char *p, const char *end) {
+  const char *q = static_cast<const char *>(std::memchr(p, '\n', end - p));
+  if (q == nullptr) q = end;
+  if (q != p && q[-1] == '\r') --q;
+  return q;
+}
+
+/*! \return beginning of the line after the one starting at p */
+inline const char *NextLine(const char *p, const char *end) {
+  const char *q = static_cast<const char *>(std::memchr(p, '\n', end - p));
+  return q == nullptr ? end : q + 1;
+}
+
+/*! \return whether the line has nothing but blanks */
+inline bool IsBlankLine(const char *begin, const char *end) {
+  for (; begin != end; ++begin) {
+    if (*begin != ' ' && *begin != '\t') return false;
+  }
+  return true;
+}
+
+/*!
+* \brief read a whole file
+* \param file_name path of the file
+* \param skip_header whether to skip the first line
+* \param text the content of the file
+* \return where the content starts in text
+*/
+inline size_t ReadTextFile(const std::string &file_name, bool skip_header,
+                           std::string *text) {
+  std::ifstream fin(file_name, std::ios::binary | std::ios::ate);
+  CHECK(fin) << "Cannot open " << file_name;
+  text->resize(fin.tellg());
+  fin.seekg(0);
+  fin.read(&(*text)[0], text->size());
+  CHECK(fin) << "Cannot read " << file_name;
+  const char *begin = text->data();
+  const char *end = begin + text->size();
+  return skip_header ? NextLine(begin, end) - begin : 0;
+}
+
+/*!
+* \brief run fn(i) for i in [0, n), each in its own thread
+*/
+template <typename Fn>
+inline void ParallelRun(int n, Fn fn) {
+  std::vector<std::thread> workers;
+  for (int i = 1; i < n; ++i) {
+    workers.emplace_back(fn, i);
+  }
+  fn(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+}  // namespace private_
+
+template <typename Alloc>
+size_t CSVIter::ParseText(const std::string &text, size_t text_begin,
+                          int label_column, int num_threads, Alloc alloc) {
+  const char *begin = text.data() + text_begin;
+  const char *end = text.data() + text.size();
+  while (begin != end &&
+         private_::IsBlankLine(begin, private_::LineEnd(begin, end))) {
+    begin = private_::NextLine(begin, end);
+  }
+  CHECK(begin != end) << "No example in the CSV file";
+  const char *first_end = private_::LineEnd(begin, end);
+  size_t num_columns = std::count(begin, first_end, ',') + 1;
+  CHECK_LT(label_column, static_cast<int>(num_columns))
+      << "label_column is out of range";
+  size_t data_columns = num_columns - (label_column >= 0 ? 1 : 0);
+
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // split the text at line boundaries so that each thread parses whole lines
+  std::vector<const char *> bounds(num_threads + 1, end);
+  bounds[0] = begin;
+  for (int i = 1; i < num_threads; ++i) {
+    const char *p = begin + (end - begin) / num_threads * i;
+    bounds[i] = private_::NextLine(std::max(p, bounds[i - 1]), end);
+  }
+
+  // first pass counts the rows, so that the second one writes in place
+  std::vector<size_t> row_begin(num_threads + 1, 0);
+  private_::ParallelRun(num_threads, [&](int i) {
+    size_t rows = 0;
+    for (const char *p = bounds[i]; p != bounds[i + 1];) {
+      const char *line_end = private_::LineEnd(p, bounds[i + 1]);
+      if (!private_::IsBlankLine(p, line_end)) ++rows;
+      p = private_::NextLine(line_end, bounds[i + 1]);
+    }
+    row_begin[i + 1] = rows;
+  });
+  for (int i = 0; i < num_threads; ++i) {
+    row_begin[i + 1] += row_begin[i];
+  }
+  size_t num_rows = row_begin[num_threads];
+  std::pair<mx_float *, mx_float *> out = alloc(num_rows, num_columns);
+
+  // a failure in a worker is reported by the calling thread
+  std::vector<const char *> bad_lines(num_threads, nullptr);
+  private_::ParallelRun(num_threads, [&](int i) {
+    mx_float *data = out.first + row_begin[i] * data_columns;
+    mx_float *label =
+        out.second == nullptr ? nullptr : out.second + row_begin[i];
+    for (const char *p = bounds[i]; p != bounds[i + 1];) {
+      const char *line_end = private_::LineEnd(p, bounds[i + 1]);
+      if (!private_::IsBlankLine(p, line_end)) {
+        const char *q = p;
+        size_t col = 0;
+        for (; col < num_columns; ++col) {
+          if (col > 0) {
+            if (q == line_end || *q != ',') break;
+            ++q;
+          }
+          mx_float value;
+          const char *next = private_::ParseFloat(q, line_end, &value);
+          if (next == q) break;
+          q = next;
+          while (q != line_end && (*q == ' ' || *q == '\t')) ++q;
+          if (static_cast<int>(col) == label_column) {
+            *label++ = value;
+          } else {
+            *data++ = value;
+          }
+        }
+        // a short row would shift the rows after it
+        if (col != num_columns || q != line_end) {
+          bad_lines[i] = p;
+          return;
+        }
+      }
+      p = private_::NextLine(line_end, bounds[i + 1]);
+    }
+  });
+  for (auto line : bad_lines) {
+    CHECK(line == nullptr) << "Cannot parse line of CSV file, " << num_columns
+                           << " numbers expected: "
+                           << std::string(line, private_::LineEnd(line, end));
+  }
+  return num_rows;
+}
+
+CSVIter::CSVIter(const std::string &file_name, int batch_size)
+    : file_name_(file_name),
+      batch_size_(batch_size),
+      label_column_(-1),
+      has_header_(false),
+      shuffle_(false),
+      num_threads_(0) {}
+
+CSVIter &CSVIter::SetLabelColumn(int label_column) {
+  label_column_ = label_column;
+  return *this;
+}
+
+CSVIter &CSVIter::SetHeader(bool has_header) {
+  has_header_ = has_header;
+  return *this;
+}
+
+CSVIter &CSVIter::SetDataShape(const Shape &data_shape) {
+  data_shape_ = data_shape;
+  return *this;
+}
+
+CSVIter &CSVIter::SetShuffle(bool shuffle) {
+  shuffle_ = shuffle;
+  return *this;
+}
+
+CSVIter &CSVIter::SetNumThreads(int num_threads) {
+  num_threads_ = num_threads;
+  return *this;
+}
+
+size_t CSVIter::Parse(const std::string &file_name, int label_column,
+                      bool has_header, std::vector<mx_float> *data,
+                      std::vector<mx_float> *label, int num_threads) {
+  std::string text;
+  size_t text_begin = private_::ReadTextFile(file_name, has_header, &text);
+  return ParseText(text, text_begin, label_column, num_threads,
+                   [&](size_t rows, size_t columns) {
+    size_t data_columns = columns - (label_column >= 0 ? 1 : 0);
+    data->resize(rows * data_columns);
+    mx_float *label_ptr = nullptr;
+    if (label_column >= 0) {
+      label->resize(rows);
+      label_ptr = label->data();
+    }
+    return std::make_pair(data->data(), label_ptr);
+  });
+}
+
+void CSVIter::Load() {
+  std::string text;
+  size_t text_begin = private_::ReadTextFile(file_name_, has_header_, &text);
+  NDArray data, label;
+  // parse directly into the memory of the arrays
+  ParseText(text, text_begin, label_column_, num_threads_,
+            [&](size_t rows, size_t columns) {
+    size_t data_columns = columns - (label_column_ >= 0 ? 1 : 0);
+    std::vector<index_t> shape(1, rows);
+    if (data_shape_.ndim() == 0) {
+      shape.push_back(data_columns);
+    } else {
+      CHECK_EQ(data_shape_.Size(), data_columns)
+          << "data_shape does not match the number of columns";
+      for (index_t i = 0; i < data_shape_.ndim(); ++i) {
+        shape.push_back(data_shape_[i]);
+      }
+    }
+    data = NDArray(Shape(shape), Context::cpu(), false);
+    label = NDArray(Shape(rows), Context::cpu(), false);
+    mx_float *label_ptr = nullptr;
+    if (label_column_ >= 0) {
+      label_ptr = NDArrayView<mx_float>(label).GetData();
+    } else {
+      label = 0.0f;
+    }
+    return std::make_pair(NDArrayView<mx_float>(data).GetData(), label_ptr);
+  });
+  iter_.reset(new NDArrayIter(data, label, batch_size_, shuffle_));
+}
+
+void CSVIter::BeforeFirst() {
+  if (iter_ == nullptr) Load();
+  iter_->BeforeFirst();
+}
+
+bool CSVIter::Next() {
+  if (iter_ == nullptr) Load();
+  return iter_->Next();
+}
+
+NDArray CSVIter::GetData() { return iter_->GetData(); }
+
+NDArray CSVIter::GetLabel() { return iter_->GetLabel(); }
+
+int CSVIter::GetPadNum() { return iter_->GetPadNum(); }
+
+std::vector<int> CSVIter::GetIndex() { return iter_->GetIndex(); }
+
+const uint32_t MmapWriter::kMagic;
+const uint32_t MmapWriter::kVersion;
+const size_t MmapWriter::kAlignment;
+
+namespace private_ {
+/*! \brief append a little endian integer to a header */
+template <typename T>
+inline void WriteInteger(std::string *header, T value) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    header->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+/*! \brief read a little endian integer of a header */
+template <typename T>
+inline T ReadInteger(const char **p, const char *end) {
+  CHECK_LE(sizeof(T), static_cast<size_t>(end - *p))
+      << "Truncated header of mmap dataset";
+  T value = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    value |= static_cast<T>(static_cast<unsigned char>((*p)[i])) << (8 * i);
+  }
+  *p += sizeof(T);
+  return value;
+}
+
+/*! \brief serialize the header of the mmap dataset format */
+inline std::string MmapHeader(const Shape &data_shape,
+                              const Shape &label_shape, uint64_t num_records) {
+  std::string header;
+  WriteInteger<uint32_t>(&header, MmapWriter::kMagic);
+  WriteInteger<uint32_t>(&header, MmapWriter::kVersion);
+  WriteInteger<uint32_t>(&header, 0);
+  for (const Shape *shape : {&data_shape, &label_shape}) {
+    WriteInteger<uint32_t>(&header, shape->ndim());
+    for (index_t i = 0; i < shape->ndim(); ++i) {
+      WriteInteger<uint32_t>(&header, (*shape)[i]);
+    }
+  }
+  WriteInteger<uint64_t>(&header, num_records);
+  size_t align = MmapWriter::kAlignment;
+  header.resize((header.size() + align - 1) / align * align, '\0');
+  return header;
+}
+
+/*! \brief read a shape of the header */
+inline Shape ReadShape(const char **p, const char *end) {
+  uint32_t ndim = ReadInteger<uint32_t>(p, end);
+  // each dimension takes 4 bytes of what remains of the header
+  CHECK_LE(ndim, static_cast<size_t>(end - *p) / sizeof(uint32_t))
+      << "Truncated header of mmap dataset";
+  std::vector<index_t> dims(ndim);
+  for (auto &dim : dims) {
+    dim = ReadInteger<uint32_t>(p, end);
+  }
+  return Shape(dims);
+}
+}  // namespace private_
+
+MmapWriter::MmapWriter(const std::string &file_name, const Shape &data_shape,
+                       const Shape &label_shape)
+    : out_(file_name, std::ios::binary | std::ios::trunc),
+      data_shape_(data_shape),
+      label_shape_(label_shape),
+      num_records_(0),
+      closed_(false) {
+  CHECK(out_) << "Cannot create " << file_name;
+  CHECK_GT(data_shape_.ndim(), 0) << "data_shape should not be empty";
+  // written again with the number of records by Close
+  std::string header = private_::MmapHeader(data_shape_, label_shape_, 0);
+  out_.write(header.data(), header.size());
+}
+
+MmapWriter::~MmapWriter() {
+  // a destructor must not throw, call Close to see the errors
+  try {
+    Close();
+  } catch (const std::exception &e) {
+    LOG(ERROR) << e.what();
+  }
+}
+
+size_t MmapWriter::HeaderSize(const Shape &data_shape,
+                              const Shape &label_shape) {
+  return private_::MmapHeader(data_shape, label_shape, 0).size();
+}
+
+void MmapWriter::Write(const mx_float *data, const mx_float *label,
+                       size_t num_records) {
+  CHECK(!closed_) << "Write after Close";
+  out_.write(reinterpret_cast<const char *>(data),
+             num_records * data_shape_.Size() * sizeof(mx_float));
+  CHECK(out_) << "Cannot write the mmap dataset";
+  size_t label_size = num_records * label_shape_.Size();
+  if (label == nullptr) {
+    labels_.resize(labels_.size() + label_size, 0);
+  } else {
+    labels_.insert(labels_.end(), label, label + label_size);
+  }
+  num_records_ += num_records;
+}
+
+void MmapWriter::Close() {
+  if (closed_) return;
+  closed_ = true;
+  out_.write(reinterpret_cast<const char *>(labels_.data()),
+             labels_.size() * sizeof(mx_float));
+  std::string header =
+      private_::MmapHeader(data_shape_, label_shape_, num_records_);
+  out_.seekp(0);
+  out_.write(header.data(), header.size());
+  out_.close();
+  CHECK(out_) << "Cannot write the mmap dataset";
+  labels_.clear();
+}
+
+MmapIter::MmapIter(const std::string &file_name, int batch_size,
+                   const Context &context, bool shuffle, bool discard_last)
+    : base_(nullptr),
+      file_size_(0),
+      batch_size_(batch_size),
+      shuffle_(shuffle),
+      cursor_(0),
+      begin_(0),
+      pad_num_(0) {
+  CHECK_GT(batch_size, 0);
+#ifdef _WIN32
+  LOG(FATAL) << "MmapIter is only supported on POSIX systems";
+#else
+  int fd = open(file_name.c_str(), O_RDONLY);
+  CHECK_GE(fd, 0) << "Cannot open " << file_name;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Cannot stat " << file_name;
+  file_size_ = st.st_size;
+  CHECK_GT(file_size_, 0) << "Empty file " << file_name;
+  void *addr = mmap(nullptr, file_size_, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping holds its own reference to the file
+  close(fd);
+  CHECK(addr != MAP_FAILED) << "Cannot map " << file_name;
+  base_ = static_cast<const char *>(addr);
+  posix_madvise(addr, file_size_,
+                shuffle_ ? POSIX_MADV_RANDOM : POSIX_MADV_SEQUENTIAL);
+#endif
+
+  const char *p = base_;
+  const char *end = base_ + file_size_;
+  CHECK_EQ(private_::ReadInteger<uint32_t>(&p, end), MmapWriter::kMagic)
+      << file_name << " is not a mmap dataset";
+  CHECK_EQ(private_::ReadInteger<uint32_t>(&p, end), MmapWriter::kVersion)
+      << "Unsupported version of mmap dataset";
+  CHECK_EQ(private_::ReadInteger<uint32_t>(&p, end), 0)
+      << "Only float32 mmap datasets are supported";
+  Shape data_shape = private_::ReadShape(&p, end);
+  Shape label_shape = private_::ReadShape(&p, end);
+  num_examples_ = private_::ReadInteger<uint64_t>(&p, end);
+  data_stride_ = data_shape.Size();
+  label_stride_ = label_shape.Size();
+  data_offset_ = MmapWriter::HeaderSize(data_shape, label_shape);
+  label_offset_ = data_offset_ + num_examples_ * data_stride_ * sizeof(mx_float);
+  CHECK_EQ(label_offset_ + num_examples_ * label_stride_ * sizeof(mx_float),
+           file_size_)
+      << "Size of " << file_name << " does not match its header";
+  CHECK_LE(batch_size_, num_examples_)
+      << "there are fewer examples than batch_size";
+
+  mx_uint num_batch = discard_last
+                          ? num_examples_ / batch_size_
+                          : (num_examples_ + batch_size_ - 1) / batch_size_;
+  for (mx_uint i = 0; i < num_batch; ++i) {
+    order_.push_back(i);
+  }
+  std::vector<index_t> shape(1, batch_size_);
+  for (index_t i = 0; i < data_shape.ndim(); ++i) {
+    shape.push_back(data_shape[i]);
+  }
+  data_ = NDArray(Shape(shape), context, false);
+  shape.resize(1);
+  for (index_t i = 0; i < label_shape.ndim(); ++i) {
+    shape.push_back(label_shape[i]);
+  }
+  label_ = NDArray(Shape(shape), context, false);
+}
+
+MmapIter::~MmapIter() {
+#ifndef _WIN32
+  // the copies out of the mapping are synchronous, nothing reads it any more
+  if (base_ != nullptr) {
+    munmap(const_cast<char *>(base_), file_size_);
+  }
+#endif
+}
+
+void MmapIter::CopyRecords(size_t first, mx_uint count, mx_uint dst) {
+  const mx_float *data =
+      reinterpret_cast<const mx_float *>(base_ + data_offset_);
+  const mx_float *label =
+      reinterpret_cast<const mx_float *>(base_ + label_offset_);
+  data_.Slice(dst, dst + count)
+      .SyncCopyFromCPU(data + first * data_stride_, count * data_stride_);
+  label_.Slice(dst, dst + count)
+      .SyncCopyFromCPU(label + first * label_stride_, count * label_stride_);
+}
+
+void MmapIter::WillNeed(size_t first) const {
+#ifndef _WIN32
+  size_t count = std::min<size_t>(batch_size_, num_examples_ - first);
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t ranges[2][2] = {
+      {data_offset_ + first * data_stride_ * sizeof(mx_float),
+       count * data_stride_ * sizeof(mx_float)},
+      {label_offset_ + first * label_stride_ * sizeof(mx_float),
+       count * label_stride_ * sizeof(mx_float)}};
+  for (auto &range : ranges) {
+    size_t begin = range[0] / page * page;
+    posix_madvise(const_cast<char *>(base_) + begin,
+                  range[0] + range[1] - begin, POSIX_MADV_WILLNEED);
+  }
+#endif
+}
+
+void MmapIter::BeforeFirst() {
+  cursor_ = 0;
+  pad_num_ = 0;
+  if (shuffle_) {
+    std::shuffle(order_.begin(), order_.end(), rng_);
+  }
+  if (!order_.empty()) {
+    WillNeed(static_cast<size_t>(order_[0]) * batch_size_);
+  }
+}
+
+bool MmapIter::Next() {
+  if (cursor_ >= order_.size()) return false;
+  begin_ = order_[cursor_++] * batch_size_;
+  mx_uint count = std::min<size_t>(batch_size_, num_examples_ - begin_);
+  pad_num_ = batch_size_ - count;
+  CopyRecords(begin_, count, 0);
+  if (pad_num_ > 0) {
+    // complete the last batch with the first records
+    CopyRecords(0, pad_num_, count);
+  }
+  if (cursor_ < order_.size()) {
+    WillNeed(static_cast<size_t>(order_[cursor_]) * batch_size_);
+  }
+  return true;
+}
+
+NDArray MmapIter::GetData() { return data_; }
+
+NDArray MmapIter::GetLabel() { return label_; }
+
+int MmapIter::GetPadNum() { return pad_num_; }
+
+std::vector<int> MmapIter::GetIndex() {
+  std::vector<int> index(batch_size_);
+  for (mx_uint i = 0; i < batch_size_; ++i) {
+    index[i] = (begin_ + i) % num_examples_;
+  }
+  return index;
+}
+
+RecordIOWriter::RecordIOWriter(const std::string &uri) {
+  CHECK_EQ(MXRecordIOWriterCreate(uri.c_str(), &handle_), 0);
+}
+
+RecordIOWriter::~RecordIOWriter() { MXRecordIOWriterFree(handle_); }
+
+void RecordIOWriter::WriteRecord(const char *buf, size_t size) {
+  // the C API declares a pointer to the handle but expects the handle itself
+  CHECK_EQ(MXRecordIOWriterWriteRecord(
+               reinterpret_cast<RecordIOHandle *>(handle_), buf, size),
+           0);
+}
+
+RecordIOReader::RecordIOReader(const std::string &uri) {
+  CHECK_EQ(MXRecordIOReaderCreate(uri.c_str(), &handle_), 0);
+}
+
+RecordIOReader::~RecordIOReader() {
+  MXRecordIOReaderFree(reinterpret_cast<RecordIOHandle *>(handle_));
+}
+
+bool RecordIOReader::ReadRecord(const char **buf, size_t *size) {
+  CHECK_EQ(MXRecordIOReaderReadRecord(
+               reinterpret_cast<RecordIOHandle *>(handle_), buf, size),
+           0);
+  return *buf != nullptr;
+}
+
+bool RecordIOReader::ReadRecord(std::string *record) {
+  const char *buf;
+  size_t size;
+  if (!ReadRecord(&buf, &size)) return false;
+  record->assign(buf, size);
+  return true;
+}
+
+RecordIOIter::RecordIOIter(const std::string &uri, int batch_size,
+                           const Shape &data_shape, const Shape &label_shape,
+                           Decoder decoder, int num_threads)
+    : uri_(uri),
+      batch_size_(batch_size),
+      data_size_(data_shape.Size()),
+      label_size_(label_shape.Size()),
+      decoder_(decoder),
+      num_threads_(num_threads > 0
+                       ? num_threads
+                       : std::max(1u, std::thread::hardware_concurrency())),
+      records_(batch_size),
+      host_data_(batch_size * data_size_),
+      host_label_(batch_size * label_size_),
+      num_read_(0),
+      record_begin_(0),
+      first_num_(0),
+      pad_num_(0),
+      end_of_data_(false) {
+  CHECK_GT(batch_size, 0);
+  if (!decoder_) {
+    size_t data_size = data_size_, label_size = label_size_;
+    decoder_ = [data_size, label_size](const char *buf, size_t size,
+                                       mx_float *data, mx_float *label) {
+      CHECK_EQ(size, (label_size + data_size) * sizeof(mx_float))
+          << "Record of unexpected size";
+      std::memcpy(label, buf, label_size * sizeof(mx_float));
+      std::memcpy(data, buf + label_size * sizeof(mx_float),
+                  data_size * sizeof(mx_float));
+    };
+  }
+  std::vector<index_t> shape(1, batch_size_);
+  for (index_t i = 0; i < data_shape.ndim(); ++i) {
+    shape.push_back(data_shape[i]);
+  }
+  data_ = NDArray(Shape(shape), Context::cpu(), false);
+  shape.resize(1);
+  for (index_t i = 0; i < label_shape.ndim(); ++i) {
+    shape.push_back(label_shape[i]);
+  }
+  label_ = NDArray(Shape(shape), Context::cpu(), false);
+  reader_.reset(new RecordIOReader(uri_));
+}
+
+std::string RecordIOIter::EncodeRecord(const mx_float *data, size_t data_size,
+                                       const mx_float *label,
+                                       size_t label_size) {
+  std::string record(reinterpret_cast<const char *>(label),
+                     label_size * sizeof(mx_float));
+  record.append(reinterpret_cast<const char *>(data),
+                data_size * sizeof(mx_float));
+  return record;
+}
+
+void RecordIOIter::BeforeFirst() {
+  // the C API cannot seek, start over with a new reader
+  if (num_read_ != 0 || end_of_data_) {
+    reader_.reset(new RecordIOReader(uri_));
+  }
+  num_read_ = 0;
+  record_begin_ = 0;
+  pad_num_ = 0;
+  end_of_data_ = false;
+}
+
+bool RecordIOIter::Next() {
+  if (end_of_data_) return false;
+  mx_uint num = 0;
+  while (num < batch_size_ && reader_->ReadRecord(&records_[num])) {
+    ++num;
+  }
+  end_of_data_ = num < batch_size_;
+  if (num == 0) return false;
+  record_begin_ = num_read_;
+  num_read_ += num;
+
+  // an exception cannot leave the parallel region, a failure is reported
+  // by the calling thread after the loop
+  std::vector<std::string> errors(num);
+  std::vector<char> failed(num, 0);
+  #pragma omp parallel for num_threads(num_threads_) schedule(dynamic)
+  for (int i = 0; i < static_cast<int>(num); ++i) {
+    try {
+      decoder_(records_[i].data(), records_[i].size(),
+               host_data_.data() + i * data_size_,
+               host_label_.data() + i * label_size_);
+    } catch (const std::exception &e) {
+      errors[i] = e.what();
+      failed[i] = 1;
+    } catch (...) {
+      failed[i] = 1;
+    }
+  }
+  for (mx_uint i = 0; i < num; ++i) {
+    CHECK(!failed[i]) << "Cannot decode record " << record_begin_ + i
+                      << " of " << uri_ << ": " << errors[i];
+  }
+
+  if (record_begin_ == 0) {
+    first_data_ = host_data_;
+    first_label_ = host_label_;
+    first_num_ = num;
+  }
+  // complete the last batch with the first examples, the first batch is
+  // only incomplete if it is also the last one
+  pad_num_ = batch_size_ - num;
+  for (mx_uint i = num; i < batch_size_; ++i) {
+    size_t src = (i - num) % first_num_;
+    std::copy_n(first_data_.begin() + src * data_size_, data_size_,
+                host_data_.begin() + i * data_size_);
+    std::copy_n(first_label_.begin() + src * label_size_, label_size_,
+                host_label_.begin() + i * label_size_);
+  }
+  data_.SyncCopyFromCPU(host_data_.data(), host_data_.size());
+  label_.SyncCopyFromCPU(host_label_.data(), host_label_.size());
+  return true;
+}
+
+NDArray RecordIOIter::GetData() { return data_; }
+
+NDArray RecordIOIter::GetLabel() { return label_; }
+
+int RecordIOIter::GetPadNum() { return pad_num_; }
+
+std::vector<int> RecordIOIter::GetIndex() {
+  std::vector<int> index(batch_size_);
+  mx_uint num = batch_size_ - pad_num_;
+  for (mx_uint i = 0; i < batch_size_; ++i) {
+    index[i] = i < num ? record_begin_ + i : (i - num) % first_num_;
+  }
+  return index;
+}
+
 }  // namespace cpp
 }  // namespace mxnet
 
 #endif /* end of include guard: MXNETCPP_IO_HPP */
-
@@ -8,7 +8,10 @@
 #ifndef MXNETCPP_KVSTORE_H
 #define MXNETCPP_KVSTORE_H
 
+#include <map>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 #include "mxnet-cpp/ndarray.h"
 
@@ -43,6 +46,73 @@ class KVStore {
   std::unique_ptr<Optimizer> optimizer_;
 };
 
+/*!
+* \brief packs the values of many small keys into buckets pushed and pulled
+*  as a single key, to reduce the number of messages of distributed
+*  training. The keys are grouped in the order given to Init, a bucket holds
+*  consecutive keys of the same context and type up to bucket_bytes, and is
+*  stored in the kvstore under the key of its first member. A key larger
+*  than bucket_bytes is a bucket of its own and is sent without copies.
+*
+*  The optimizer of the kvstore updates whole buckets, so it should be
+*  elementwise and configured identically for all the keys.
+*/
+class BucketedKVStore {
+ public:
+  /*!
+  * \param kvstore the kvstore, it is not owned and should outlive this
+  * \param bucket_bytes the maximum size of a bucket in bytes
+  */
+  explicit inline BucketedKVStore(KVStore* kvstore,
+      size_t bucket_bytes = 4 << 20);
+  /*!
+  * \brief group the keys into buckets and initialize the buckets
+  * \param keys the keys, all the keys should be given in a single call
+  * \param vals the initial values
+  */
+  inline void Init(const std::vector<int>& keys,
+      const std::vector<NDArray>& vals);
+  /*!
+  * \brief copy vals into their buckets and push the buckets. All the keys of
+  *  a bucket should be pushed together, a key pushed from several devices
+  *  is summed like in KVStore::Push
+  */
+  inline void Push(const std::vector<int>& keys,
+      const std::vector<NDArray>& vals, int priority = 0);
+  /*! \brief pull the buckets of keys and copy them out into outs */
+  inline void Pull(const std::vector<int>& keys, std::vector<NDArray>* outs,
+      int priority = 0);
+  /*! \return number of buckets */
+  size_t GetNumBuckets() const { return buckets_.size(); }
+
+ private:
+  /*! \brief memory of a bucket on a context, with a view per member */
+  struct Buffer {
+    NDArray data;
+    std::vector<NDArray> views;
+  };
+  struct Bucket {
+    std::vector<int> keys;
+    std::vector<Shape> shapes;
+    std::vector<size_t> offsets;
+    size_t size;
+    DType dtype;
+    /*! \brief buffers by device type and id */
+    std::map<std::pair<int, int>, Buffer> buffers;
+  };
+  /*! \brief position of a key in the buckets */
+  struct Slot {
+    size_t bucket;
+    size_t index;
+  };
+  inline const Slot& GetSlot(int key) const;
+  inline Buffer& GetBuffer(Bucket* bucket, const Context& context);
+  KVStore* kvstore_;
+  size_t bucket_bytes_;
+  std::vector<Bucket> buckets_;
+  std::map<int, Slot> slots_;
+};
+
 }  // namespace cpp
 }  // namespace mxnet
 
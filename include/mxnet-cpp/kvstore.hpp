@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <map>
 #include <numeric>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -38,10 +39,17 @@ namespace private_ {
       }
       float lr = std::stof(params.at("learning_rate"));
       float wd = std::stof(params.at("weight_decay"));
-      std::unique_ptr<Optimizer> opt(new Optimizer(params.at("opt_type"), lr, wd));
+      std::unique_ptr<Optimizer> opt(
+          Optimizer::Create(params.at("opt_type"), lr, wd));
+      auto lr_scheduler = params.find("lr_scheduler");
+      if (lr_scheduler != params.end()) {
+        opt->SetLRScheduler(std::unique_ptr<LRScheduler>(
+            LRScheduler::Create(lr_scheduler->second)));
+      }
       params.erase("opt_type");
       params.erase("learning_rate");
       params.erase("weight_decay");
+      params.erase("lr_scheduler");
       for (const auto& pair : params) {
         opt->SetParam(pair.first, pair.second);
       }
@@ -176,6 +184,154 @@ std::string KVStore::GetRole() const {
   return "worker";
 }
 
+BucketedKVStore::BucketedKVStore(KVStore* kvstore, size_t bucket_bytes)
+    : kvstore_(kvstore), bucket_bytes_(bucket_bytes) {
+  CHECK(kvstore_ != nullptr);
+}
+
+void BucketedKVStore::Init(const std::vector<int>& keys,
+                           const std::vector<NDArray>& vals) {
+  CHECK_EQ(keys.size(), vals.size());
+  CHECK(buckets_.empty()) << "Init should be called once";
+  // in elements, the types of less than 4 bytes get smaller buckets
+  size_t bucket_size = bucket_bytes_ / sizeof(mx_float);
+  std::vector<Context> contexts;
+  // position in vals of the first member of each bucket
+  std::vector<size_t> firsts;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    CHECK_EQ(slots_.count(keys[i]), 0) << "key " << keys[i] << " is duplicated";
+    size_t size = vals[i].Size();
+    Context context = vals[i].GetContext();
+    DType dtype = vals[i].GetDType();
+    bool fits = false;
+    if (!buckets_.empty()) {
+      const Bucket& last = buckets_.back();
+      fits = last.size + size <= bucket_size && last.dtype == dtype &&
+             contexts.back().GetDeviceType() == context.GetDeviceType() &&
+             contexts.back().GetDeviceId() == context.GetDeviceId();
+    }
+    if (!fits) {
+      buckets_.emplace_back();
+      buckets_.back().size = 0;
+      buckets_.back().dtype = dtype;
+      contexts.push_back(context);
+      firsts.push_back(i);
+    }
+    Bucket& bucket = buckets_.back();
+    slots_[keys[i]] = Slot{buckets_.size() - 1, bucket.keys.size()};
+    bucket.keys.push_back(keys[i]);
+    bucket.shapes.push_back(vals[i].GetShapeRef());
+    bucket.offsets.push_back(bucket.size);
+    bucket.size += size;
+  }
+
+  std::vector<int> init_keys;
+  std::vector<NDArray> init_vals;
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    Bucket& bucket = buckets_[i];
+    init_keys.push_back(bucket.keys[0]);
+    if (bucket.keys.size() == 1) {
+      init_vals.push_back(vals[firsts[i]]);
+      continue;
+    }
+    Buffer& buffer = GetBuffer(&bucket, contexts[i]);
+    for (size_t j = 0; j < bucket.keys.size(); ++j) {
+      vals[firsts[i] + j].CopyTo(&buffer.views[j]);
+    }
+    init_vals.push_back(buffer.data);
+  }
+  kvstore_->Init(init_keys, init_vals);
+}
+
+void BucketedKVStore::Push(const std::vector<int>& keys,
+                           const std::vector<NDArray>& vals, int priority) {
+  CHECK_EQ(keys.size(), vals.size());
+  std::vector<int> push_keys;
+  std::vector<NDArray> push_vals;
+  // members of each buffer written by this call, and how many they are
+  std::map<Buffer*, std::pair<std::vector<bool>, size_t> > written;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    const Slot& slot = GetSlot(keys[i]);
+    Bucket& bucket = buckets_[slot.bucket];
+    if (bucket.keys.size() == 1) {
+      push_keys.push_back(keys[i]);
+      push_vals.push_back(vals[i]);
+      continue;
+    }
+    Buffer& buffer = GetBuffer(&bucket, vals[i].GetContext());
+    auto& mask = written[&buffer];
+    mask.first.resize(bucket.keys.size(), false);
+    CHECK(!mask.first[slot.index])
+        << "key " << keys[i] << " is pushed twice from the same device";
+    mask.first[slot.index] = true;
+    vals[i].CopyTo(&buffer.views[slot.index]);
+    if (++mask.second == bucket.keys.size()) {
+      push_keys.push_back(bucket.keys[0]);
+      push_vals.push_back(buffer.data);
+    }
+  }
+  for (const auto& pair : written) {
+    CHECK_EQ(pair.second.second, pair.second.first.size())
+        << "all the keys of a bucket should be pushed together";
+  }
+  kvstore_->Push(push_keys, push_vals, priority);
+}
+
+void BucketedKVStore::Pull(const std::vector<int>& keys,
+                           std::vector<NDArray>* outs, int priority) {
+  CHECK_EQ(keys.size(), outs->size());
+  std::vector<int> pull_keys;
+  std::vector<NDArray> pull_outs;
+  std::vector<Buffer*> buffers(keys.size(), nullptr);
+  std::set<Buffer*> pulled;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    const Slot& slot = GetSlot(keys[i]);
+    Bucket& bucket = buckets_[slot.bucket];
+    if (bucket.keys.size() == 1) {
+      pull_keys.push_back(keys[i]);
+      pull_outs.push_back((*outs)[i]);
+      continue;
+    }
+    buffers[i] = &GetBuffer(&bucket, (*outs)[i].GetContext());
+    // a bucket is pulled once per device, whatever its number of members
+    if (pulled.insert(buffers[i]).second) {
+      pull_keys.push_back(bucket.keys[0]);
+      pull_outs.push_back(buffers[i]->data);
+    }
+  }
+  kvstore_->Pull(pull_keys, &pull_outs, priority);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (buffers[i] != nullptr) {
+      buffers[i]->views[GetSlot(keys[i]).index].CopyTo(&(*outs)[i]);
+    }
+  }
+}
+
+const BucketedKVStore::Slot& BucketedKVStore::GetSlot(int key) const {
+  auto it = slots_.find(key);
+  CHECK(it != slots_.end()) << "key " << key << " is not initialized";
+  return it->second;
+}
+
+BucketedKVStore::Buffer& BucketedKVStore::GetBuffer(Bucket* bucket,
+                                                    const Context& context) {
+  auto device = std::make_pair(static_cast<int>(context.GetDeviceType()),
+                               context.GetDeviceId());
+  auto it = bucket->buffers.find(device);
+  if (it != bucket->buffers.end()) {
+    return it->second;
+  }
+  Buffer& buffer = bucket->buffers[device];
+  buffer.data = NDArray(Shape(bucket->size), context, false, bucket->dtype);
+  for (size_t i = 0; i < bucket->keys.size(); ++i) {
+    buffer.views.push_back(
+        buffer.data.Slice(bucket->offsets[i],
+                          bucket->offsets[i] + bucket->shapes[i].Size())
+            .Reshape(bucket->shapes[i]));
+  }
+  return buffer;
+}
+
 }  // namespace cpp
 }  // namespace mxnet
 
@@ -0,0 +1,267 @@
+/*!
+*  Copyright (c) 2016 by Contributors
+* \file lr_scheduler.h
+* \brief learning rate schedulers consulted by the optimizers
+*/
+
+#ifndef MXNETCPP_LR_SCHEDULER_H
+#define MXNETCPP_LR_SCHEDULER_H
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "mxnet-cpp/base.h"
+#include "mxnet-cpp/logging.h"
+
+namespace mxnet {
+namespace cpp {
+
+/*!
+* \brief learning rate as a function of the number of updates.
+*  Every scheduler supports a linear warmup from warmup_begin_lr to the base
+*  learning rate during the first warmup_steps updates.
+*/
+class LRScheduler {
+ public:
+  /*!
+  * \param base_lr the learning rate the schedule starts from, the optimizer
+  *  sets it to its own learning rate
+  * \param warmup_steps number of updates of the warmup, 0 for none
+  * \param warmup_begin_lr learning rate at the beginning of the warmup
+  */
+  explicit LRScheduler(mx_float base_lr = 0.01, unsigned warmup_steps = 0,
+                       mx_float warmup_begin_lr = 0)
+      : base_lr_(base_lr),
+        warmup_steps_(warmup_steps),
+        warmup_begin_lr_(warmup_begin_lr),
+        has_lr_(false) {}
+  virtual ~LRScheduler() {}
+  /*! \param lr the learning rate the schedule starts from */
+  void SetLR(mx_float lr) {
+    base_lr_ = lr;
+    has_lr_ = true;
+  }
+  /*!
+  * \return whether the learning rate was set by SetLR, like the one of a
+  *  scheduler created by Create
+  */
+  bool HasLR() const { return has_lr_; }
+  /*!
+  * \param num_update number of updates so far
+  * \return the learning rate
+  */
+  mx_float GetLR(unsigned num_update) const {
+    if (num_update < warmup_steps_) {
+      return warmup_begin_lr_ +
+             (base_lr_ - warmup_begin_lr_) * num_update / warmup_steps_;
+    }
+    return DecayLR(num_update);
+  }
+  /*!
+  * \brief serialize the scheduler to a single line, the format is the type
+  *  followed by the parameters, like "factor;step=100;factor=0.9"
+  * \return serialization
+  */
+  std::string Serialize() const {
+    std::map<std::string, std::string> params;
+    GetParams(&params);
+    params["base_lr"] = ToString(base_lr_);
+    params["warmup_steps"] = ToString(warmup_steps_);
+    params["warmup_begin_lr"] = ToString(warmup_begin_lr_);
+    std::string ret = GetType();
+    for (const auto &param : params) {
+      ret += ';' + param.first + '=' + param.second;
+    }
+    return ret;
+  }
+  /*!
+  * \brief create a scheduler from its serialization
+  * \param serialized the output of Serialize
+  * \return the new scheduler, which need to be free manually
+  */
+  static inline LRScheduler *Create(const std::string &serialized);
+
+ protected:
+  /*! \return the learning rate after the warmup */
+  virtual mx_float DecayLR(unsigned num_update) const = 0;
+  /*! \return the type used in the serialization */
+  virtual std::string GetType() const = 0;
+  /*! \brief add the parameters of the scheduler to params */
+  virtual void GetParams(std::map<std::string, std::string> *params) const = 0;
+  template <typename T>
+  static std::string ToString(const T &value) {
+    std::ostringstream ss;
+    ss.precision(9);
+    ss << value;
+    return ss.str();
+  }
+  mx_float base_lr_;
+  unsigned warmup_steps_;
+  mx_float warmup_begin_lr_;
+
+ private:
+  bool has_lr_;
+};
+
+/*!
+* \brief multiply the learning rate by factor every step updates, without
+*  going below stop_factor_lr
+*/
+class FactorScheduler : public LRScheduler {
+ public:
+  explicit FactorScheduler(unsigned step, mx_float factor = 1,
+                           mx_float stop_factor_lr = 1e-8,
+                           unsigned warmup_steps = 0,
+                           mx_float warmup_begin_lr = 0)
+      : LRScheduler(0.01, warmup_steps, warmup_begin_lr),
+        step_(step),
+        factor_(factor),
+        stop_factor_lr_(stop_factor_lr) {
+    CHECK_GE(step_, 1) << "step should be at least 1";
+    CHECK_LE(factor_, 1) << "factor should be no more than 1";
+  }
+
+ protected:
+  mx_float DecayLR(unsigned num_update) const {
+    mx_float lr = base_lr_ * std::pow(factor_, num_update / step_);
+    return std::max(lr, stop_factor_lr_);
+  }
+  std::string GetType() const { return "factor"; }
+  void GetParams(std::map<std::string, std::string> *params) const {
+    (*params)["step"] = ToString(step_);
+    (*params)["factor"] = ToString(factor_);
+    (*params)["stop_factor_lr"] = ToString(stop_factor_lr_);
+  }
+
+ private:
+  unsigned step_;
+  mx_float factor_, stop_factor_lr_;
+};
+
+/*!
+* \brief multiply the learning rate by factor after each of the given
+*  numbers of updates
+*/
+class MultiFactorScheduler : public LRScheduler {
+ public:
+  explicit MultiFactorScheduler(const std::vector<unsigned> &steps,
+                                mx_float factor = 1,
+                                unsigned warmup_steps = 0,
+                                mx_float warmup_begin_lr = 0)
+      : LRScheduler(0.01, warmup_steps, warmup_begin_lr),
+        steps_(steps),
+        factor_(factor) {
+    for (size_t i = 1; i < steps_.size(); ++i) {
+      CHECK_LT(steps_[i - 1], steps_[i]) << "steps should be increasing";
+    }
+    CHECK_LE(factor_, 1) << "factor should be no more than 1";
+  }
+
+ protected:
+  mx_float DecayLR(unsigned num_update) const {
+    mx_float lr = base_lr_;
+    for (size_t i = 0; i < steps_.size() && num_update > steps_[i]; ++i) {
+      lr *= factor_;
+    }
+    return lr;
+  }
+  std::string GetType() const { return "multifactor"; }
+  void GetParams(std::map<std::string, std::string> *params) const {
+    std::string steps;
+    for (size_t i = 0; i < steps_.size(); ++i) {
+      steps += (i == 0 ? "" : ",") + ToString(steps_[i]);
+    }
+    (*params)["step"] = steps;
+    (*params)["factor"] = ToString(factor_);
+  }
+
+ private:
+  std::vector<unsigned> steps_;
+  mx_float factor_;
+};
+
+/*!
+* \brief cosine decay from the base learning rate to final_lr at max_update,
+*  the warmup updates included
+*/
+class CosineScheduler : public LRScheduler {
+ public:
+  explicit CosineScheduler(unsigned max_update, mx_float final_lr = 0,
+                           unsigned warmup_steps = 0,
+                           mx_float warmup_begin_lr = 0)
+      : LRScheduler(0.01, warmup_steps, warmup_begin_lr),
+        max_update_(max_update),
+        final_lr_(final_lr) {
+    CHECK_GT(max_update_, warmup_steps)
+        << "max_update should be larger than warmup_steps";
+  }
+
+ protected:
+  mx_float DecayLR(unsigned num_update) const {
+    if (num_update >= max_update_) return final_lr_;
+    const double pi = 3.14159265358979323846;
+    double progress = static_cast<double>(num_update - warmup_steps_) /
+                      (max_update_ - warmup_steps_);
+    return final_lr_ +
+           (base_lr_ - final_lr_) * (1 + std::cos(pi * progress)) / 2;
+  }
+  std::string GetType() const { return "cosine"; }
+  void GetParams(std::map<std::string, std::string> *params) const {
+    (*params)["max_update"] = ToString(max_update_);
+    (*params)["final_lr"] = ToString(final_lr_);
+  }
+
+ private:
+  unsigned max_update_;
+  mx_float final_lr_;
+};
+
+LRScheduler *LRScheduler::Create(const std::string &serialized) {
+  std::istringstream sin(serialized);
+  std::string type, item;
+  std::getline(sin, type, ';');
+  std::map<std::string, std::string> params;
+  while (std::getline(sin, item, ';')) {
+    size_t n = item.find('=');
+    CHECK_NE(n, std::string::npos) << "Invalid lr_scheduler " << serialized;
+    params[item.substr(0, n)] = item.substr(n + 1);
+  }
+  auto get = [&params, &serialized](const std::string &key) {
+    CHECK(params.count(key)) << "Missing " << key << " in lr_scheduler "
+                             << serialized;
+    return params[key];
+  };
+  unsigned warmup_steps = std::stoul(get("warmup_steps"));
+  mx_float warmup_begin_lr = std::stof(get("warmup_begin_lr"));
+  LRScheduler *ret = nullptr;
+  if (type == "factor") {
+    ret = new FactorScheduler(std::stoul(get("step")), std::stof(get("factor")),
+                              std::stof(get("stop_factor_lr")), warmup_steps,
+                              warmup_begin_lr);
+  } else if (type == "multifactor") {
+    std::vector<unsigned> steps;
+    std::istringstream steps_in(get("step"));
+    std::string step;
+    while (std::getline(steps_in, step, ',')) {
+      steps.push_back(std::stoul(step));
+    }
+    ret = new MultiFactorScheduler(steps, std::stof(get("factor")),
+                                   warmup_steps, warmup_begin_lr);
+  } else if (type == "cosine") {
+    ret = new CosineScheduler(std::stoul(get("max_update")),
+                              std::stof(get("final_lr")), warmup_steps,
+                              warmup_begin_lr);
+  } else {
+    LOG(FATAL) << "Unknown lr_scheduler " << type;
+  }
+  ret->SetLR(std::stof(get("base_lr")));
+  return ret;
+}
+
+}  // namespace cpp
+}  // namespace mxnet
+
+#endif  // MXNETCPP_LR_SCHEDULER_H
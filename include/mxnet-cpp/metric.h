@@ -9,28 +9,230 @@
 #define MXNETCPP_METRIC_H
 
 #include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 #include <algorithm>
 #include "mxnet-cpp/ndarray.h"
+#include "mxnet-cpp/ndarray.hpp"
+#include "mxnet-cpp/ndarray_view.h"
 #include "mxnet-cpp/logging.h"
 
 namespace mxnet {
 namespace cpp {
 
+namespace private_ {
+/*!
+* \brief run a NDArray function into a new array
+* \param func the function
+* \param inputs the arrays it reads
+* \param scalars its scalar arguments
+* \return the output, whose shape is inferred by the function
+*/
+inline NDArray InvokeFunction(FunctionHandle func,
+                              const std::vector<NDArray> &inputs,
+                              std::vector<mx_float> scalars = {}) {
+  NDArray ret;
+  std::vector<NDArrayHandle> handles;
+  for (const auto &input : inputs) {
+    handles.push_back(input.GetHandle());
+  }
+  NDArrayHandle out = ret.GetHandle();
+  CHECK_EQ(MXFuncInvoke(func, handles.data(), scalars.data(), &out), 0);
+  return ret;
+}
+/*! \return the sum of all the elements of data, of shape (1) */
+inline NDArray Sum(NDArray data) {
+  static FunctionHandle func = GetFunctionHandle("sum");
+  return InvokeFunction(func, {data});
+}
+inline NDArray Abs(NDArray data) {
+  static FunctionHandle func = GetFunctionHandle("abs");
+  return InvokeFunction(func, {data});
+}
+/*! \return -1, 0 or 1 by the sign of every element of data */
+inline NDArray Sign(NDArray data) {
+  static FunctionHandle func = GetFunctionHandle("sign");
+  return InvokeFunction(func, {data});
+}
+inline NDArray Square(NDArray data) {
+  static FunctionHandle func = GetFunctionHandle("square");
+  return InvokeFunction(func, {data});
+}
+inline NDArray Log(NDArray data) {
+  static FunctionHandle func = GetFunctionHandle("log");
+  return InvokeFunction(func, {data});
+}
+inline NDArray Clip(NDArray data, mx_float a_min, mx_float a_max) {
+  static FunctionHandle func = GetFunctionHandle("clip");
+  return InvokeFunction(func, {data}, {a_min, a_max});
+}
+/*! \return the matrix product of lhs and rhs */
+inline NDArray Dot(NDArray lhs, NDArray rhs) {
+  static FunctionHandle func = GetFunctionHandle("dot");
+  return InvokeFunction(func, {lhs, rhs});
+}
+/*!
+* \return the element of every row of data of shape (batch, num_class) at
+*  the column given by index of shape (batch)
+*/
+inline NDArray Pick(NDArray data, NDArray index) {
+  static FunctionHandle func = GetFunctionHandle("choose_element_0index");
+  return InvokeFunction(func, {data, index});
+}
+}  // namespace private_
+
+/*!
+* \brief base class of the metrics.
+*  Update does not wait for the predictions: Prepare reduces the batch on
+*  its device to the values the metric needs, usually a few sums of shape
+*  (1), those are copied to CPU arrays by engine operations, and a
+*  background thread accumulates them once they are ready. The arrays
+*  given to Update can be overwritten right after it returns. Get and Reset
+*  wait for the batches queued so far, and only for them. An exception of
+*  Accumulate is rethrown by the next call to Update, Get or Reset.
+*
+*  A metric implements Prepare and Accumulate, and calls Wait in its
+*  destructor, so that no batch is accumulated once it is destroyed.
+*  Overriding Update instead, to accumulate synchronously, is still
+*  supported.
+*/
 class EvalMetric {
  public:
   explicit EvalMetric(const std::string& name, int num = 0)
-      : name(name), num(num) {}
-  virtual void Update(NDArray labels, NDArray preds) = 0;
-  void Reset() {
+      : name(name), num(num), num_pending_(0), stop_(false) {}
+  virtual ~EvalMetric() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    if (worker_.joinable()) {
+      worker_.join();
+    }
+  }
+  /*!
+  * \brief queue the evaluation of a batch
+  * \param labels the labels, copied to the context of preds if needed
+  * \param preds the predictions
+  */
+  virtual void Update(NDArray labels, NDArray preds) {
+    RethrowError();
+    // the labels often stay on the CPU while the outputs are on a GPU
+    Context ctx = preds.GetContext();
+    Context label_ctx = labels.GetContext();
+    if (label_ctx.GetDeviceType() != ctx.GetDeviceType() ||
+        label_ctx.GetDeviceId() != ctx.GetDeviceId()) {
+      if (labels_.GetShapeRef() != labels.GetShapeRef() ||
+          labels_.GetContext().GetDeviceType() != ctx.GetDeviceType() ||
+          labels_.GetContext().GetDeviceId() != ctx.GetDeviceId() ||
+          labels_.GetDType() != labels.GetDType()) {
+        labels_ = NDArray(labels.GetShapeRef(), ctx, false, labels.GetDType());
+      }
+      labels.CopyTo(&labels_);
+      labels = labels_;
+    }
+    std::vector<NDArray> values = Prepare(labels, preds);
+    std::unique_lock<std::mutex> lock(mutex_);
+    // reuse the arrays of a batch already accumulated
+    Batch batch;
+    if (!free_.empty()) {
+      batch = std::move(free_.back());
+      free_.pop_back();
+    }
+    lock.unlock();
+    batch.num = labels.Size();
+    batch.packed = IsPackable(values);
+    if (batch.packed) {
+      // gather the scalars on their device to copy them in one transfer
+      Shape shape(values.size());
+      Context ctx = values[0].GetContext();
+      if (batch.staging.GetShapeRef() != shape ||
+          batch.staging.GetContext().GetDeviceId() != ctx.GetDeviceId()) {
+        batch.staging = NDArray(shape, ctx, false);
+      }
+      for (size_t i = 0; i < values.size(); ++i) {
+        NDArray slot = batch.staging.Slice(i, i + 1);
+        values[i].CopyTo(&slot);
+      }
+      values.assign(1, batch.staging);
+    }
+    batch.snapshots.resize(values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (batch.snapshots[i].GetShapeRef() != values[i].GetShapeRef()) {
+        batch.snapshots[i] =
+            NDArray(values[i].GetShapeRef(), Context::cpu(), false);
+      }
+      values[i].CopyTo(&batch.snapshots[i]);
+    }
+    lock.lock();
+    if (!worker_.joinable()) {
+      worker_ = std::thread(&EvalMetric::Run, this);
+    }
+    queue_.push_back(std::move(batch));
+    ++num_pending_;
+    lock.unlock();
+    cond_.notify_all();
+  }
+  virtual void Reset() {
+    Wait();
+    RethrowError();
     num_inst = 0;
     sum_metric = 0.0f;
   }
-  float Get() { return sum_metric / num_inst; }
-  void GetNameValue();
+  virtual float Get() {
+    Wait();
+    RethrowError();
+    return sum_metric / num_inst;
+  }
+  const std::string &GetName() const { return name; }
+  /*! \return the names and the values of the metric */
+  virtual std::vector<std::pair<std::string, float> > GetNameValue() {
+    return {std::make_pair(name, Get())};
+  }
 
  protected:
+  /*!
+  * \brief wait until the queued batches are accumulated, does not throw so
+  *  that destructors can call it
+  */
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this]() { return num_pending_ == 0; });
+  }
+  /*! \brief rethrow the first exception of Accumulate since the last call */
+  void RethrowError() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (error_) {
+      std::exception_ptr error = error_;
+      error_ = nullptr;
+      lock.unlock();
+      std::rethrow_exception(error);
+    }
+  }
+  /*!
+  * \brief called by Update to reduce a batch on its device
+  * \return the arrays Accumulate needs, labels and preds by default
+  */
+  virtual std::vector<NDArray> Prepare(NDArray labels, NDArray preds) {
+    return std::vector<NDArray>{labels, preds};
+  }
+  /*!
+  * \brief add a batch to sum_metric and num_inst, called on the
+  *  background thread
+  * \param values views of the CPU copies of the arrays of Prepare
+  * \param num number of labels of the batch
+  */
+  virtual void Accumulate(
+      const std::vector<NDArrayView<const mx_float> > &values, size_t num) {
+    LOG(FATAL) << name << " should implement Accumulate or Update";
+  }
   std::string name;
   int num;
   float sum_metric = 0.0f;
@@ -42,46 +244,375 @@ class EvalMetric {
     // inplement this
     return true;
   }
+
+ private:
+  friend class CompositeEvalMetric;
+  struct Batch {
+    /*! \brief the CPU copies of the arrays of Prepare */
+    std::vector<NDArray> snapshots;
+    /*! \brief the device array the scalars are gathered in, if packed */
+    NDArray staging;
+    size_t num = 0;
+    bool packed = false;
+  };
+  EvalMetric(const EvalMetric &);
+  EvalMetric &operator=(const EvalMetric &);
+  /*!
+  * \return whether values are several scalars on the same GPU, which are
+  *  cheaper to copy to the host together
+  */
+  static bool IsPackable(const std::vector<NDArray> &values) {
+    if (values.size() < 2) return false;
+    for (const auto &value : values) {
+      Context ctx = value.GetContext();
+      if (value.Size() != 1 || ctx.GetDeviceType() != DeviceType::kGPU ||
+          ctx.GetDeviceId() != values[0].GetContext().GetDeviceId()) {
+        return false;
+      }
+    }
+    return true;
+  }
+  /*! \brief the loop of the background thread */
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cond_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      Batch batch = std::move(queue_.front());
+      queue_.pop_front();
+      lock.unlock();
+      std::exception_ptr error;
+      try {
+        // waits for the copies of this batch only
+        std::vector<NDArrayView<const mx_float> > values;
+        for (const auto &snapshot : batch.snapshots) {
+          values.emplace_back(snapshot);
+        }
+        if (batch.packed) {
+          NDArrayView<const mx_float> packed = values[0];
+          values.clear();
+          for (index_t i = 0; i < packed.Size(); ++i) {
+            values.push_back(packed.Slice(i, i + 1));
+          }
+        }
+        Accumulate(values, batch.num);
+      } catch (...) {
+        // an exception escaping the thread would terminate the process
+        error = std::current_exception();
+      }
+      lock.lock();
+      if (error && !error_) {
+        error_ = error;
+      }
+      free_.push_back(std::move(batch));
+      --num_pending_;
+      cond_.notify_all();
+    }
+  }
+  /*! \brief the labels copied to the context of the predictions */
+  NDArray labels_;
+  /*! \brief CPU copies of the batches waiting to be accumulated */
+  std::deque<Batch> queue_;
+  std::vector<Batch> free_;
+  size_t num_pending_;
+  bool stop_;
+  /*! \brief the first exception of Accumulate, see RethrowError */
+  std::exception_ptr error_;
+  std::thread worker_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
 };
 
+/*!
+* \brief accuracy of the classes predicted by preds of shape
+*  (batch, num_class), on labels of shape (batch)
+*/
 class Accuracy : public EvalMetric {
  public:
   Accuracy() : EvalMetric("accuracy") {}
+  ~Accuracy() { Wait(); }
+
+ protected:
+  std::vector<NDArray> Prepare(NDArray labels, NDArray preds) {
+    CHECK_EQ(labels.GetShapeRef().ndim(), 1);
+    // 1 for every wrong prediction
+    NDArray wrong =
+        private_::Sign(private_::Abs(preds.ArgmaxChannel() - labels));
+    return std::vector<NDArray>{private_::Sum(wrong)};
+  }
+  void Accumulate(const std::vector<NDArrayView<const mx_float> > &values,
+                  size_t num) {
+    sum_metric += num - values[0][0];
+    num_inst += num;
+  }
+};
+
+/*!
+* \brief fraction of the labels among the top_k classes of preds, ties
+*  counting as hits
+*/
+class TopKAccuracy : public EvalMetric {
+ public:
+  explicit TopKAccuracy(int top_k)
+      : EvalMetric("top_k_accuracy_" + std::to_string(top_k)),
+        top_k_(top_k) {
+    CHECK_GE(top_k_, 1) << "top_k should be at least 1";
+  }
+  ~TopKAccuracy() { Wait(); }
+
+ protected:
+  std::vector<NDArray> Prepare(NDArray labels, NDArray preds) {
+    CHECK_EQ(labels.GetShapeRef().ndim(), 1);
+    CHECK_EQ(preds.GetShapeRef().ndim(), 2);
+    mx_uint len = preds.GetShapeRef()[0], num_class = preds.GetShapeRef()[1];
+    Context ctx = preds.GetContext();
+    if (ones_row_.Size() != num_class ||
+        ones_row_.GetContext().GetDeviceType() != ctx.GetDeviceType() ||
+        ones_row_.GetContext().GetDeviceId() != ctx.GetDeviceId()) {
+      ones_row_ = NDArray(Shape(1, num_class), ctx, false);
+      ones_row_ = 1.0f;
+      ones_col_ = NDArray(Shape(num_class, 1), ctx, false);
+      ones_col_ = 1.0f;
+    }
+    // the score of the label, broadcast to every class
+    NDArray label_score = private_::Dot(
+        private_::Pick(preds, labels).Reshape(Shape(len, 1)), ones_row_);
+    // 1 for the classes scored higher than the label, 0 otherwise
+    NDArray cmp = private_::Sign(preds - label_score);
+    NDArray higher = (cmp + private_::Abs(cmp)) * 0.5f;
+    NDArray rank = private_::Dot(higher, ones_col_);
+    // -1 for the labels ranked below top_k, 1 for the others
+    NDArray hit = private_::Sign(rank - (top_k_ - 0.5f));
+    return std::vector<NDArray>{private_::Sum(hit)};
+  }
+  void Accumulate(const std::vector<NDArrayView<const mx_float> > &values,
+                  size_t num) {
+    sum_metric += (num - values[0][0]) / 2;
+    num_inst += num;
+  }
+
+ private:
+  int top_k_;
+  NDArray ones_row_, ones_col_;
+};
 
-  void Update(NDArray labels, NDArray preds) {
-    CHECK_EQ(labels.GetShape().size(), 1);
-    mx_uint len = labels.GetShape()[0];
-    std::vector<mx_float> pred_data(len);
-    std::vector<mx_float> label_data(len);
-    preds.ArgmaxChannel().SyncCopyToCPU(&pred_data, len);
-    labels.SyncCopyToCPU(&label_data, len);
-    NDArray::WaitAll();
-    for (mx_uint i = 0; i < len; ++i) {
-      sum_metric += (pred_data[i] == label_data[i]) ? 1 : 0;
-      num_inst += 1;
+/*!
+* \brief F1 score of a binary classification, preds of shape (batch, 2),
+*  averaged over the batches
+*/
+class F1 : public EvalMetric {
+ public:
+  F1() : EvalMetric("f1") {}
+  ~F1() { Wait(); }
+
+ protected:
+  std::vector<NDArray> Prepare(NDArray labels, NDArray preds) {
+    CHECK_EQ(labels.GetShapeRef().ndim(), 1);
+    CHECK_EQ(preds.GetShapeRef()[1], 2) << "F1 is for binary classification";
+    NDArray positive = preds.ArgmaxChannel();
+    return std::vector<NDArray>{private_::Sum(positive * labels),
+                                private_::Sum(positive),
+                                private_::Sum(labels)};
+  }
+  void Accumulate(const std::vector<NDArrayView<const mx_float> > &values,
+                  size_t num) {
+    float true_positive = values[0][0];
+    float precision =
+        values[1][0] > 0 ? true_positive / values[1][0] : 0.0f;
+    float recall = values[2][0] > 0 ? true_positive / values[2][0] : 0.0f;
+    if (precision + recall > 0) {
+      sum_metric += 2 * precision * recall / (precision + recall);
     }
+    num_inst += 1;
   }
 };
 
+/*! \brief mean absolute error of preds of the shape of labels */
+class MAE : public EvalMetric {
+ public:
+  MAE() : EvalMetric("mae") {}
+  ~MAE() { Wait(); }
+
+ protected:
+  std::vector<NDArray> Prepare(NDArray labels, NDArray preds) {
+    CHECK_EQ(labels.Size(), preds.Size());
+    NDArray diff = labels - preds.Reshape(labels.GetShapeRef());
+    return std::vector<NDArray>{private_::Sum(private_::Abs(diff))};
+  }
+  void Accumulate(const std::vector<NDArrayView<const mx_float> > &values,
+                  size_t num) {
+    sum_metric += values[0][0];
+    num_inst += num;
+  }
+};
+
+/*! \brief mean squared error of preds of the shape of labels */
+class MSE : public EvalMetric {
+ public:
+  MSE() : EvalMetric("mse") {}
+  ~MSE() { Wait(); }
+
+ protected:
+  explicit MSE(const std::string &name) : EvalMetric(name) {}
+  std::vector<NDArray> Prepare(NDArray labels, NDArray preds) {
+    CHECK_EQ(labels.Size(), preds.Size());
+    NDArray diff = labels - preds.Reshape(labels.GetShapeRef());
+    return std::vector<NDArray>{private_::Sum(private_::Square(diff))};
+  }
+  void Accumulate(const std::vector<NDArrayView<const mx_float> > &values,
+                  size_t num) {
+    sum_metric += values[0][0];
+    num_inst += num;
+  }
+};
+
+/*!
+* \brief root mean squared error of preds of the shape of labels, averaged
+*  over the batches
+*/
+class RMSE : public MSE {
+ public:
+  RMSE() : MSE("rmse") {}
+  ~RMSE() { Wait(); }
+
+ protected:
+  void Accumulate(const std::vector<NDArrayView<const mx_float> > &values,
+                  size_t num) {
+    sum_metric += std::sqrt(values[0][0] / num);
+    num_inst += 1;
+  }
+};
+
+/*!
+* \brief mean negative log of the probabilities preds of shape
+*  (batch, num_class) give to labels of shape (batch)
+*/
+class CrossEntropy : public EvalMetric {
+ public:
+  explicit CrossEntropy(mx_float epsilon = 1e-12)
+      : EvalMetric("cross-entropy"), epsilon_(epsilon) {}
+  ~CrossEntropy() { Wait(); }
+
+ protected:
+  std::vector<NDArray> Prepare(NDArray labels, NDArray preds) {
+    CHECK_EQ(labels.GetShapeRef().ndim(), 1);
+    NDArray prob = private_::Pick(preds, labels) + epsilon_;
+    return std::vector<NDArray>{private_::Sum(private_::Log(prob))};
+  }
+  void Accumulate(const std::vector<NDArrayView<const mx_float> > &values,
+                  size_t num) {
+    sum_metric -= values[0][0];
+    num_inst += num;
+  }
+
+ private:
+  mx_float epsilon_;
+};
+
+/*!
+* \brief mean negative log of the probabilities preds of shape
+*  (batch, num_class) give to labels of shape (batch), clipped to 1e-15
+*/
 class LogLoss : public EvalMetric {
  public:
   LogLoss() : EvalMetric("logloss") {}
+  ~LogLoss() { Wait(); }
+
+ protected:
+  std::vector<NDArray> Prepare(NDArray labels, NDArray preds) {
+    CHECK_EQ(labels.GetShapeRef().ndim(), 1);
+    static const mx_float epsilon = 1e-15;
+    NDArray prob = private_::Clip(private_::Pick(preds, labels), epsilon, 1);
+    return std::vector<NDArray>{private_::Sum(private_::Log(prob))};
+  }
+  void Accumulate(const std::vector<NDArrayView<const mx_float> > &values,
+                  size_t num) {
+    sum_metric -= values[0][0];
+    num_inst += num;
+  }
+};
 
-  void Update(NDArray labels, NDArray preds) {
-    static const float epsilon = 1e-15;
-    mx_uint len = labels.GetShape()[0];
-    mx_uint m = preds.GetShape()[1];
-    std::vector<mx_float> pred_data(len * m);
-    std::vector<mx_float> label_data(len);
-    preds.SyncCopyToCPU(&pred_data, pred_data.size());
-    labels.SyncCopyToCPU(&label_data, len);
-    NDArray::WaitAll();
-    for (mx_uint i = 0; i < len; ++i) {
-      sum_metric +=
-          -std::log(std::max(pred_data[i * m + label_data[i]], epsilon));
-      num_inst += 1;
+/*!
+* \brief several metrics evaluated together. Update runs the Prepare of
+*  every child on the device, then the values of all the children are
+*  copied to the host at once and accumulated by a single background thread,
+*  so adding a metric adds no transfer of its own. The children should only
+*  be updated through the composite.
+*/
+class CompositeEvalMetric : public EvalMetric {
+ public:
+  CompositeEvalMetric() : EvalMetric("composite") {}
+  ~CompositeEvalMetric() { Wait(); }
+  /*! \param metric the metric to add */
+  void Add(std::shared_ptr<EvalMetric> metric) {
+    Wait();
+    children_.push_back(metric);
+    num_values_.clear();
+  }
+  /*! \return the index-th metric added */
+  std::shared_ptr<EvalMetric> GetMetric(size_t index) const {
+    return children_.at(index);
+  }
+  void Reset() {
+    Wait();
+    RethrowError();
+    for (auto &child : children_) {
+      child->Reset();
     }
   }
+  /*! \return the value of the first metric */
+  float Get() {
+    CHECK(!children_.empty()) << "no metric in the composite";
+    Wait();
+    RethrowError();
+    return children_[0]->Get();
+  }
+  std::vector<std::pair<std::string, float> > GetNameValue() {
+    Wait();
+    RethrowError();
+    std::vector<std::pair<std::string, float> > ret;
+    for (auto &child : children_) {
+      auto values = child->GetNameValue();
+      ret.insert(ret.end(), values.begin(), values.end());
+    }
+    return ret;
+  }
+
+ protected:
+  std::vector<NDArray> Prepare(NDArray labels, NDArray preds) {
+    CHECK(!children_.empty()) << "no metric in the composite";
+    // the number of values of every child is read by Accumulate, it is only
+    // written by the first batch
+    bool first = num_values_.empty();
+    std::vector<NDArray> ret;
+    for (size_t i = 0; i < children_.size(); ++i) {
+      std::vector<NDArray> values = children_[i]->Prepare(labels, preds);
+      if (first) {
+        num_values_.push_back(values.size());
+      } else {
+        CHECK_EQ(num_values_[i], values.size())
+            << children_[i]->GetName() << " changed its number of values";
+      }
+      ret.insert(ret.end(), values.begin(), values.end());
+    }
+    return ret;
+  }
+  void Accumulate(const std::vector<NDArrayView<const mx_float> > &values,
+                  size_t num) {
+    auto begin = values.begin();
+    for (size_t i = 0; i < children_.size(); ++i) {
+      std::vector<NDArrayView<const mx_float> > child_values(
+          begin, begin + num_values_[i]);
+      children_[i]->Accumulate(child_values, num);
+      begin += num_values_[i];
+    }
+  }
+
+ private:
+  std::vector<std::shared_ptr<EvalMetric> > children_;
+  std::vector<size_t> num_values_;
 };
 
 }  // namespace cpp
@@ -8,11 +8,19 @@
 #ifndef MXNETCPP_MODEL_H
 #define MXNETCPP_MODEL_H
 
+#include <future>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include "mxnet-cpp/base.h"
 #include "mxnet-cpp/symbol.h"
 #include "mxnet-cpp/ndarray.h"
+#include "mxnet-cpp/executor_group.h"
+#include "mxnet-cpp/initializer.h"
+#include "mxnet-cpp/io.h"
+#include "mxnet-cpp/kvstore.h"
+#include "mxnet-cpp/metric.h"
 
 namespace mxnet {
 namespace cpp {
@@ -21,38 +29,138 @@ struct FeedForwardConfig {
   Symbol symbol;
   std::vector<Context> ctx = {Context::cpu()};
   int num_epoch = 0;
+  /*! \brief number of batches of an epoch, 0 for a pass over the data */
   int epoch_size = 0;
+  /*! \brief the type of optimizer, see Optimizer::Create */
   std::string optimizer = "sgd";
-  // TODO(zhangchen-qinyinghua) More implement
-  // initializer=Uniform(0.01),
-  // numpy_batch_size=128,
-  // arg_params=None, aux_params=None,
-  // allow_extra_params=False,
-  // begin_epoch=0,
-  // **kwargs):
-  FeedForwardConfig(const FeedForwardConfig &other) {}
-  FeedForwardConfig() {}
+  /*! \brief parameters of the optimizer, like momentum */
+  std::map<std::string, std::string> optimizer_params;
+  mx_float learning_rate = 0.01;
+  mx_float weight_decay = 0;
+  /*! \brief initializer of the parameters not given in arg_params */
+  std::shared_ptr<Initializer> initializer = std::make_shared<Xavier>();
+  std::map<std::string, NDArray> arg_params;
+  std::map<std::string, NDArray> aux_params;
+  int begin_epoch = 0;
+  /*! \brief the type of kvstore reducing the gradients of the devices */
+  std::string kvstore = "local";
+  /*! \brief names of the arguments the batches are bound to */
+  std::string data_name = "data";
+  std::string label_name = "label";
+  /*! \brief number of batches loaded in advance */
+  int prefetch_depth = 2;
 };
+
+/*!
+* \brief trains and runs a symbol on the devices of its configuration.
+*  The executors are bound once for a shape of batches and fed in place,
+*  the batches are prefetched in the background, the gradients of all the
+*  devices are summed by a kvstore and all the parameters are updated by a
+*  single batched Update per step, and the metrics of a batch are computed
+*  while the next one runs.
+*/
 class FeedForward {
  public:
-  explicit FeedForward(const FeedForwardConfig &conf) : conf_(conf) {}
-  void Predict();
-  void Score();
-  void Fit();
-  void Save();
-  void Load();
-  static FeedForward Create();
+  explicit FeedForward(const FeedForwardConfig &conf);
+  /*!
+  * \brief run the model on all the batches of data
+  * \param data the batches, the label is not needed
+  * \param num_batch maximum number of batches, -1 for all of them
+  * \return the outputs of the symbol for all the examples, on the CPU
+  */
+  std::vector<NDArray> Predict(DataIter *data, int num_batch = -1);
+  /*!
+  * \brief evaluate the model on the batches of data
+  * \param data the batches
+  * \param metric the metric, reset first
+  * \param num_batch maximum number of batches, -1 for all of them
+  * \return the value of the metric
+  */
+  float Score(DataIter *data, EvalMetric *metric, int num_batch = -1);
+  /*!
+  * \brief train the model for the epochs from begin_epoch to num_epoch
+  * \param train_data the training batches
+  * \param eval_data the batches evaluated after each epoch, nullptr for
+  *  none
+  * \param metric the metric of the training and evaluation, nullptr for
+  *  none
+  * \param checkpoint_prefix if not empty, the model is saved with this
+  *  prefix every checkpoint_period epochs, in the background
+  * \param checkpoint_period number of epochs between checkpoints
+  */
+  void Fit(DataIter *train_data, DataIter *eval_data = nullptr,
+           EvalMetric *metric = nullptr,
+           const std::string &checkpoint_prefix = "",
+           int checkpoint_period = 1);
+  /*!
+  * \brief save the symbol to prefix-symbol.json and the parameters to
+  *  prefix-%04d.params, the format of the other frontends
+  * \param prefix the prefix of the files
+  * \param epoch the epoch number of the parameters
+  */
+  void Save(const std::string &prefix, int epoch);
+  /*!
+  * \brief load a model saved by Save
+  * \param prefix the prefix of the files
+  * \param epoch the epoch number of the parameters
+  * \param conf the configuration, its symbol and parameters are replaced
+  * \return the model, whose begin_epoch is epoch
+  */
+  static FeedForward Load(const std::string &prefix, int epoch,
+                          const FeedForwardConfig &conf = FeedForwardConfig());
+  /*!
+  * \brief create a model and train it, see Fit
+  * \return the trained model
+  */
+  static FeedForward Create(const FeedForwardConfig &conf,
+                            DataIter *train_data,
+                            DataIter *eval_data = nullptr,
+                            EvalMetric *metric = nullptr);
+  /*! \return the parameters, on the CPU */
+  const std::map<std::string, NDArray> &GetArgParams() const {
+    return conf_.arg_params;
+  }
+  /*! \return the auxiliary states, on the CPU */
+  const std::map<std::string, NDArray> &GetAuxParams() const {
+    return conf_.aux_params;
+  }
 
  private:
-  void InitParams();
-  void InitPredictor();
-  void InitIter();
-  void InitEvalIter();
+  /*!
+  * \brief initialize the parameters missing from arg_params and aux_params
+  * \param input_shapes the shapes of the inputs
+  */
+  void InitParams(
+      const std::map<std::string, std::vector<mx_uint> > &input_shapes);
+  /*!
+  * \brief bind the group for inference on batches of data_shape, unless
+  *  it is already
+  */
+  void InitPredictor(const std::vector<mx_uint> &data_shape);
+  /*!
+  * \brief rewind data and wrap it into an iterator prefetching the
+  *  batches to the devices, call Next for the first batch
+  */
+  std::unique_ptr<PrefetchingIter> InitIter(DataIter *data);
+  /*! \brief copy the parameters of group into the configuration */
+  void UpdateParams(const DataParallelExecutorGroup &group);
+  /*!
+  * \brief evaluate metric on the batches of iter with group
+  * \param iter the batches, positioned on the first one
+  */
+  float Evaluate(DataParallelExecutorGroup *group, DataIter *iter,
+                 EvalMetric *metric, int num_batch);
+  /*! \brief the context the batches are prefetched to */
+  Context GetInputContext() const;
   FeedForwardConfig conf_;
+  /*! \brief the group of Predict and Score */
+  std::unique_ptr<DataParallelExecutorGroup> predictor_;
+  std::vector<mx_uint> predictor_shape_;
+  /*! \brief the checkpoint being written */
+  std::future<void> checkpoint_;
 };
 
 }  // namespace cpp
 }  // namespace mxnet
 
 #endif /* end of include guard: MXNETCPP_MODEL_H */
-
@@ -0,0 +1,356 @@
+/*!
+ *  Copyright (c) 2016 by Contributors
+ * \file model.hpp
+ * \brief implementation of the feed forward model
+ */
+
+#ifndef MXNETCPP_MODEL_HPP
+#define MXNETCPP_MODEL_HPP
+
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mxnet-cpp/model.h"
+#include "mxnet-cpp/ndarray_loader.h"
+#include "mxnet-cpp/optimizer.h"
+
+namespace mxnet {
+namespace cpp {
+
+namespace private_ {
+/*!
+* \brief copies the outputs of a batch to the CPU and reads them only when
+*  the next batch is queued, so that the devices are not idle while the
+*  host reads
+*/
+class DeferredOutputs {
+ public:
+  explicit DeferredOutputs(size_t num_outputs)
+      : outputs_(num_outputs), num_valid_(0), pending_(false) {}
+  /*!
+  * \brief queue the copy of the outputs of the current batch
+  * \param group the group that ran the batch
+  * \param batch the batch, its label is copied if it has one
+  */
+  void Push(const DataParallelExecutorGroup &group, const DataBatch &batch) {
+    CHECK(!pending_);
+    if (label_.GetShapeRef().ndim() == 0 &&
+        batch.label.GetShapeRef().ndim() > 0) {
+      label_ = NDArray(batch.label.GetShapeRef(), Context::cpu(), false);
+    }
+    if (batch.label.GetShapeRef().ndim() > 0) {
+      batch.label.CopyTo(&label_);
+    }
+    for (size_t i = 0; i < outputs_.size(); ++i) {
+      if (outputs_[i].GetShapeRef().ndim() == 0) {
+        Shape shape = group.GetExecutors()[0]->outputs[i].GetShapeRef();
+        shape[0] = group.GetBatchSize();
+        outputs_[i] = NDArray(shape, Context::cpu(), false);
+      }
+      group.CopyOutputTo(i, &outputs_[i]);
+    }
+    num_valid_ = group.GetBatchSize() - batch.pad_num;
+    pending_ = true;
+  }
+  /*! \return whether a batch is waiting to be read */
+  bool IsPending() const { return pending_; }
+  /*! \return the label of the pending batch, without the padding */
+  NDArray GetLabel() const { return label_.Slice(0, num_valid_); }
+  /*! \return an output of the pending batch, without the padding */
+  NDArray GetOutput(size_t index) const {
+    return outputs_[index].Slice(0, num_valid_);
+  }
+  /*! \brief mark the pending batch as read */
+  void Pop() { pending_ = false; }
+
+ private:
+  NDArray label_;
+  std::vector<NDArray> outputs_;
+  mx_uint num_valid_;
+  bool pending_;
+};
+}  // namespace private_
+
+FeedForward::FeedForward(const FeedForwardConfig &conf) : conf_(conf) {
+  CHECK(!conf_.ctx.empty());
+}
+
+std::unique_ptr<PrefetchingIter> FeedForward::InitIter(DataIter *data) {
+  CHECK(data != nullptr);
+  // the iterator may have been left anywhere by a previous pass
+  data->BeforeFirst();
+  return std::unique_ptr<PrefetchingIter>(
+      new PrefetchingIter(data, GetInputContext(), conf_.prefetch_depth));
+}
+
+Context FeedForward::GetInputContext() const {
+  // the batches of several devices are split from the CPU
+  return conf_.ctx.size() == 1 ? conf_.ctx[0] : Context::cpu();
+}
+
+void FeedForward::InitParams(
+    const std::map<std::string, std::vector<mx_uint> > &input_shapes) {
+  std::vector<std::vector<mx_uint> > in_shapes, aux_shapes, out_shapes;
+  conf_.symbol.InferShape(input_shapes, &in_shapes, &aux_shapes, &out_shapes);
+  const auto arg_names = conf_.symbol.ListArguments();
+  for (size_t i = 0; i < arg_names.size(); ++i) {
+    if (input_shapes.count(arg_names[i]) > 0 ||
+        conf_.arg_params.count(arg_names[i]) > 0) {
+      continue;
+    }
+    // Uniform(0.01) for the names the initializer does not know
+    NDArray value(Shape(in_shapes[i]), Context::cpu(), false);
+    NDArray::SampleUniform(-0.01, 0.01, &value);
+    (*conf_.initializer)(arg_names[i], &value);
+    conf_.arg_params[arg_names[i]] = value;
+  }
+  const auto aux_names = conf_.symbol.ListAuxiliaryStates();
+  for (size_t i = 0; i < aux_names.size(); ++i) {
+    if (conf_.aux_params.count(aux_names[i]) > 0) {
+      continue;
+    }
+    NDArray value(Shape(aux_shapes[i]), Context::cpu(), false);
+    value = 0.0f;
+    (*conf_.initializer)(aux_names[i], &value);
+    conf_.aux_params[aux_names[i]] = value;
+  }
+}
+
+void FeedForward::InitPredictor(const std::vector<mx_uint> &data_shape) {
+  if (predictor_ != nullptr && predictor_shape_ == data_shape) {
+    return;
+  }
+  std::map<std::string, std::vector<mx_uint> > input_shapes;
+  input_shapes[conf_.data_name] = data_shape;
+  const auto arg_names = conf_.symbol.ListArguments();
+  for (size_t i = 0; i < arg_names.size(); ++i) {
+    if (arg_names[i] == conf_.label_name) {
+      // the label of the loss is not trained, its shape follows the data
+      std::vector<std::vector<mx_uint> > in_shapes, aux_shapes, out_shapes;
+      conf_.symbol.InferShape(input_shapes, &in_shapes, &aux_shapes,
+                              &out_shapes);
+      input_shapes[conf_.label_name] = in_shapes[i];
+      break;
+    }
+  }
+  InitParams(input_shapes);
+  predictor_.reset();
+  predictor_.reset(new DataParallelExecutorGroup(
+      conf_.symbol, conf_.ctx, input_shapes, nullptr, conf_.arg_params,
+      conf_.aux_params));
+  predictor_shape_ = data_shape;
+}
+
+void FeedForward::UpdateParams(const DataParallelExecutorGroup &group) {
+  group.GetParams(Context::cpu(), &conf_.arg_params, &conf_.aux_params);
+}
+
+std::vector<NDArray> FeedForward::Predict(DataIter *data, int num_batch) {
+  auto iter = InitIter(data);
+  if (num_batch == 0 || !iter->Next()) {
+    return std::vector<NDArray>();
+  }
+  InitPredictor(iter->GetData().GetShape());
+  size_t num_outputs = predictor_->GetExecutors()[0]->outputs.size();
+  private_::DeferredOutputs deferred(num_outputs);
+  std::vector<std::vector<mx_float> > results(num_outputs);
+  auto read = [&]() {
+    for (size_t i = 0; i < num_outputs; ++i) {
+      NDArray output = deferred.GetOutput(i);
+      if (output.Size() == 0) continue;
+      std::vector<mx_float> host;
+      output.SyncCopyToCPU(&host);
+      results[i].insert(results[i].end(), host.begin(), host.end());
+    }
+    deferred.Pop();
+  };
+  int n = 0;
+  do {
+    DataBatch batch = iter->GetDataBatch();
+    predictor_->SetInput(conf_.data_name, batch.data);
+    predictor_->Forward(false);
+    if (deferred.IsPending()) read();
+    deferred.Push(*predictor_, batch);
+  } while ((num_batch < 0 || ++n < num_batch) && iter->Next());
+  read();
+
+  std::vector<NDArray> ret;
+  for (size_t i = 0; i < num_outputs; ++i) {
+    Shape shape = predictor_->GetExecutors()[0]->outputs[i].GetShapeRef();
+    shape[0] = results[i].size() / (shape.Size() / shape[0]);
+    ret.emplace_back(results[i], shape, Context::cpu());
+  }
+  return ret;
+}
+
+float FeedForward::Score(DataIter *data, EvalMetric *metric, int num_batch) {
+  CHECK(metric != nullptr);
+  metric->Reset();
+  auto iter = InitIter(data);
+  if (num_batch == 0 || !iter->Next()) {
+    return metric->Get();
+  }
+  InitPredictor(iter->GetData().GetShape());
+  return Evaluate(predictor_.get(), iter.get(), metric, num_batch);
+}
+
+float FeedForward::Evaluate(DataParallelExecutorGroup *group, DataIter *iter,
+                            EvalMetric *metric, int num_batch) {
+  metric->Reset();
+  private_::DeferredOutputs deferred(1);
+  int n = 0;
+  do {
+    DataBatch batch = iter->GetDataBatch();
+    group->SetInput(conf_.data_name, batch.data);
+    group->SetInput(conf_.label_name, batch.label);
+    group->Forward(false);
+    if (deferred.IsPending()) {
+      metric->Update(deferred.GetLabel(), deferred.GetOutput(0));
+      deferred.Pop();
+    }
+    deferred.Push(*group, batch);
+  } while ((num_batch < 0 || ++n < num_batch) && iter->Next());
+  metric->Update(deferred.GetLabel(), deferred.GetOutput(0));
+  return metric->Get();
+}
+
+void FeedForward::Fit(DataIter *train_data, DataIter *eval_data,
+                      EvalMetric *metric,
+                      const std::string &checkpoint_prefix,
+                      int checkpoint_period) {
+  CHECK_GT(checkpoint_period, 0);
+  auto iter = InitIter(train_data);
+  CHECK(iter->Next()) << "no training data";
+  std::map<std::string, std::vector<mx_uint> > input_shapes;
+  input_shapes[conf_.data_name] = iter->GetData().GetShape();
+  input_shapes[conf_.label_name] = iter->GetLabel().GetShape();
+  InitParams(input_shapes);
+
+  KVStore kvstore(conf_.kvstore);
+  std::unique_ptr<Optimizer> opt(Optimizer::Create(
+      conf_.optimizer, conf_.learning_rate, conf_.weight_decay));
+  // the gradients of the devices are summed
+  opt->SetParam("rescale_grad", 1.0 / input_shapes[conf_.data_name][0]);
+  for (const auto &param : conf_.optimizer_params) {
+    opt->SetParam(param.first, param.second);
+  }
+  // the servers of a dist kvstore run the optimizer, otherwise the kvstore
+  // only sums the gradients and the group updates all the parameters at
+  // once, instead of one key at a time in the updater of the kvstore
+  bool dist = kvstore.GetType().compare(0, 4, "dist") == 0;
+  if (dist) {
+    kvstore.SetOptimizer(std::move(opt), false);
+  }
+
+  // the parameters are about to change
+  predictor_.reset();
+  DataParallelExecutorGroup group(conf_.symbol, conf_.ctx, input_shapes,
+                                  &kvstore, conf_.arg_params,
+                                  conf_.aux_params);
+  if (!dist) {
+    group.SetOptimizer(std::move(opt));
+  }
+  private_::DeferredOutputs deferred(1);
+  bool has_batch = true;
+  for (int epoch = conf_.begin_epoch; epoch < conf_.num_epoch; ++epoch) {
+    if (!has_batch) {
+      iter->BeforeFirst();
+      has_batch = iter->Next();
+    }
+    if (metric != nullptr) metric->Reset();
+    for (int n = 0; has_batch && (conf_.epoch_size <= 0 ||
+                                  n < conf_.epoch_size);
+         has_batch = iter->Next(), ++n) {
+      DataBatch batch = iter->GetDataBatch();
+      group.SetInput(conf_.data_name, batch.data);
+      group.SetInput(conf_.label_name, batch.label);
+      group.Forward(true);
+      group.Backward();
+      if (metric == nullptr) continue;
+      if (deferred.IsPending()) {
+        metric->Update(deferred.GetLabel(), deferred.GetOutput(0));
+        deferred.Pop();
+      }
+      deferred.Push(group, batch);
+    }
+    if (metric != nullptr && deferred.IsPending()) {
+      metric->Update(deferred.GetLabel(), deferred.GetOutput(0));
+      deferred.Pop();
+      for (const auto &value : metric->GetNameValue()) {
+        LG << "Epoch[" << epoch << "] Train-" << value.first << "="
+           << value.second;
+      }
+    }
+
+    if (eval_data != nullptr && metric != nullptr) {
+      auto eval_iter = InitIter(eval_data);
+      if (eval_iter->Next()) {
+        Evaluate(&group, eval_iter.get(), metric, -1);
+        for (const auto &value : metric->GetNameValue()) {
+          LG << "Epoch[" << epoch << "] Validation-" << value.first << "="
+             << value.second;
+        }
+      }
+    }
+    if (!checkpoint_prefix.empty() && (epoch + 1) % checkpoint_period == 0) {
+      UpdateParams(group);
+      Save(checkpoint_prefix, epoch + 1);
+    }
+  }
+  UpdateParams(group);
+  conf_.begin_epoch = std::max(conf_.begin_epoch, conf_.num_epoch);
+  // the kvstore goes away with the pending pushes
+  NDArray::WaitAll();
+}
+
+void FeedForward::Save(const std::string &prefix, int epoch) {
+  if (checkpoint_.valid()) {
+    checkpoint_.get();
+  }
+  conf_.symbol.Save(prefix + "-symbol.json");
+  std::map<std::string, NDArray> params;
+  for (const auto &param : conf_.arg_params) {
+    params["arg:" + param.first] = param.second;
+  }
+  for (const auto &param : conf_.aux_params) {
+    params["aux:" + param.first] = param.second;
+  }
+  char file[16];
+  snprintf(file, sizeof(file), "-%04d.params", epoch);
+  // the arrays are not modified any more, they are written while training
+  // goes on
+  std::string file_name = prefix + file;
+  checkpoint_ = std::async(std::launch::async, [file_name, params]() {
+    NDArray::Save(file_name, params);
+  });
+}
+
+FeedForward FeedForward::Load(const std::string &prefix, int epoch,
+                              const FeedForwardConfig &conf) {
+  FeedForwardConfig loaded = conf;
+  loaded.symbol = Symbol::Load(prefix + "-symbol.json");
+  char file[16];
+  snprintf(file, sizeof(file), "-%04d.params", epoch);
+  NDArrayLoader loader(prefix + file);
+  loaded.arg_params = loader.Load("arg:", Context::cpu());
+  loaded.aux_params = loader.Load("aux:", Context::cpu());
+  loaded.begin_epoch = epoch;
+  return FeedForward(loaded);
+}
+
+FeedForward FeedForward::Create(const FeedForwardConfig &conf,
+                                DataIter *train_data, DataIter *eval_data,
+                                EvalMetric *metric) {
+  FeedForward model(conf);
+  model.Fit(train_data, eval_data, metric);
+  return model;
+}
+
+}  // namespace cpp
+}  // namespace mxnet
+
+#endif  // MXNETCPP_MODEL_HPP
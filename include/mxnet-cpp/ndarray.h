@@ -8,8 +8,11 @@
 #ifndef MXNETCPP_NDARRAY_H
 #define MXNETCPP_NDARRAY_H
 
+#include <atomic>
+#include <future>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include "mxnet-cpp/base.h"
@@ -24,6 +27,17 @@ enum DeviceType {
   kCPUPinned = 3
 };
 
+/*!
+* \brief type of the elements of an NDArray, the type flags of the backend
+*/
+enum DType {
+  kFloat32 = 0,
+  kFloat64 = 1,
+  kFloat16 = 2,
+  kUint8 = 3,
+  kInt32 = 4
+};
+
 /*!
 * \brief Context interface
 */
@@ -75,12 +89,22 @@ struct NDBlob {
   /*!
   * \brief default constructor
   */
-  NDBlob() : handle_(nullptr) {}
+  NDBlob()
+      : handle_(nullptr),
+        meta_cached_(false),
+        context_(Context::cpu()),
+        dtype_(-1),
+        data_(nullptr) {}
   /*!
   * \brief construct with a NDArrayHandle
   * \param handle NDArrayHandle to store
   */
-  explicit NDBlob(NDArrayHandle handle) : handle_(handle) {}
+  explicit NDBlob(NDArrayHandle handle)
+      : handle_(handle),
+        meta_cached_(false),
+        context_(Context::cpu()),
+        dtype_(-1),
+        data_(nullptr) {}
   /*!
   * \brief destructor, free the NDArrayHandle
   */
@@ -89,6 +113,37 @@ struct NDBlob {
   * \brief the NDArrayHandle
   */
   NDArrayHandle handle_;
+  /*!
+  * \brief whether shape_ and context_ hold the metadata of handle_. The
+  *  shape of a handle never changes once it is known, except for a none
+  *  array, which stays uncached until an operation writes it. shape_ and
+  *  context_ are only written before it is set, under meta_mutex_ when the
+  *  array may already be shared between threads.
+  */
+  std::atomic<bool> meta_cached_;
+  /*!
+  * \brief serializes the threads filling the cache of a shared array
+  */
+  std::mutex meta_mutex_;
+  /*!
+  * \brief the cached shape of handle_
+  */
+  Shape shape_;
+  /*!
+  * \brief the cached context of handle_
+  */
+  Context context_;
+  /*!
+  * \brief the cached DType of handle_, -1 until known. Every thread reading
+  *  it from the backend finds the same value, so it is only atomic.
+  */
+  std::atomic<int> dtype_;
+  /*!
+  * \brief the cached data pointer of handle_, nullptr until known. The
+  *  memory of a handle does not move once allocated, and every thread
+  *  finds the same pointer, so it is only atomic like dtype_.
+  */
+  std::atomic<mx_float *> data_;
 
  private:
   NDBlob(const NDBlob &);
@@ -123,6 +178,17 @@ class NDArray {
   * \param delay_alloc whether delay the allocation
   */
   NDArray(const Shape &shape, const Context &context, bool delay_alloc = true);
+  /*!
+  * \brief construct a new dynamic NDArray of the given element type. Only
+  *  float32 arrays can be copied from and to mx_float host memory, convert
+  *  the others with CopyTo
+  * \param shape the shape of array
+  * \param context context of NDArray
+  * \param delay_alloc whether delay the allocation
+  * \param dtype the type of the elements
+  */
+  NDArray(const Shape &shape, const Context &context, bool delay_alloc,
+          DType dtype);
   NDArray(const mx_float *data, size_t size);
   /*!
   * \brief construct a new dynamic NDArray
@@ -255,6 +321,50 @@ class NDArray {
   */
   void SyncCopyToCPU(std::vector<mx_float> *data, size_t size = 0);
   /*!
+  * \brief Do an asynchronous copy from a continugous CPU memory region.
+  *
+  *  data is staged in a new CPU array before this function returns, so it
+  *  can be reused right away, then the copy into this NDArray is pushed to
+  *  the engine. It is ordered with the other operations on this NDArray
+  *  like any engine operation: it runs after the ones pushed before and
+  *  before the ones pushed after, and no other array is waited for.
+  *
+  * \param data the data source to copy from.
+  * \param size the memory size we want to copy from, which is Size().
+  * \return a future whose wait blocks until the copy is done, it does not
+  *  block in its destructor.
+  */
+  MXNETCPP_NODISCARD std::future<void> CopyFromCPUAsync(const mx_float *data,
+                                                        size_t size);
+  /*!
+  * \brief Do an asynchronous copy to a continugous CPU memory region.
+  *
+  *  A copy of this NDArray to a CPU staging array is pushed to the engine,
+  *  ordered like any engine operation: it reads the value written by the
+  *  operations pushed before, and the ones pushed after do not overwrite it.
+  *  The staging array is copied into data by get() or wait() of the
+  *  returned future, which wait for this copy only. data is not written
+  *  if the future is discarded.
+  *
+  * \param data the data source to copy into.
+  * \param size the memory size we want to copy into. Defualt value is Size()
+  * \return a future filling data when it is waited for.
+  */
+  MXNETCPP_NODISCARD std::future<void> CopyToCPUAsync(mx_float *data,
+                                                      size_t size = 0) const;
+  /*!
+  * \brief Do an asynchronous copy to a continugous CPU memory region.
+  *
+  *  data is resized before this function returns, then filled by the
+  *  returned future like CopyToCPUAsync(mx_float *, size_t).
+  *
+  * \param data the data source to copy into.
+  * \param size the memory size we want to copy into. Defualt value is Size()
+  * \return a future filling data when it is waited for.
+  */
+  MXNETCPP_NODISCARD std::future<void> CopyToCPUAsync(
+      std::vector<mx_float> *data, size_t size = 0) const;
+  /*!
   * \brief Copy the content of current array to other.
   * \param other the new context of this NDArray
   * \return the new copy
@@ -376,6 +486,20 @@ class NDArray {
   static void Save(const std::string &file_name,
                    const std::vector<NDArray> &array_list);
   /*!
+  * \brief save a map of string->NDArray to memory, in the format of the
+  *  files of Save. Read it back with NDArrayLoader::LoadFromBytes.
+  * \param array_map a map from names to NDArrays.
+  * \return the bytes
+  */
+  static std::string SaveToBytes(
+      const std::map<std::string, NDArray> &array_map);
+  /*!
+  * \brief save a list of NDArrays to memory, see SaveToBytes
+  * \param array_list a list of NDArrays.
+  * \return the bytes
+  */
+  static std::string SaveToBytes(const std::vector<NDArray> &array_list);
+  /*!
   * \return the size of current NDArray, a.k.a. the production of all shape dims
   */
   size_t Size() const;
@@ -384,14 +508,23 @@ class NDArray {
   */
   std::vector<mx_uint> GetShape() const;
   /*!
-  * \return the data pointer to the current NDArray
+  * \return the cached shape of current NDArray, no allocation and no call
+  *  into libmxnet is involved once the shape is known
+  */
+  const Shape &GetShapeRef() const;
+  /*!
+  * \return the data pointer to the current NDArray, cached like the shape
   */
   const mx_float *GetData() const;
 
   /*!
-  * \return the context of NDArray
+  * \return the context of NDArray, cached like the shape
   */
   Context GetContext() const;
+  /*!
+  * \return the type of the elements of NDArray, cached like the shape
+  */
+  DType GetDType() const;
 
   /*!
   * \return the NDArrayHandle of the current NDArray
@@ -400,6 +533,14 @@ class NDArray {
 
  private:
   std::shared_ptr<NDBlob> blob_ptr_;
+  /*!
+  * \brief fill the metadata cache from a known shape and context
+  */
+  void SetMeta(const Shape &shape, const Context &context) const;
+  /*!
+  * \return the blob with its metadata cache filled if the shape is known
+  */
+  const NDBlob &GetMeta() const;
 };
 }  // namespace cpp
 }  // namespace mxnet
@@ -8,6 +8,8 @@
 #ifndef MXNETCPP_NDARRAY_HPP
 #define MXNETCPP_NDARRAY_HPP
 
+#include <cstdint>
+#include <future>
 #include <map>
 #include <string>
 #include <vector>
@@ -17,6 +19,52 @@
 namespace mxnet {
 namespace cpp {
 
+namespace private_ {
+/*!
+* \brief resolve a NDArray function by name. Callers keep the handle in a
+*  function-local static, so each function is looked up once, at its first
+*  use, and the initialization is thread-safe.
+* \param name name of the function
+* \return the function handle
+*/
+inline FunctionHandle GetFunctionHandle(const char *name) {
+  FunctionHandle handle = nullptr;
+  CHECK_EQ(MXGetFunction(name, &handle), 0);
+  CHECK(handle != nullptr) << "Cannot find NDArray function " << name;
+  return handle;
+}
+/*!
+* \brief serialize arrays like MXNDArraySave does into a file
+* \param arrays the arrays
+* \param names their names, empty for none
+* \return the bytes
+*/
+inline std::string SaveToBytes(const std::vector<NDArray> &arrays,
+                               const std::vector<std::string> &names) {
+  std::string ret;
+  auto append = [&ret](const void *data, size_t size) {
+    ret.append(static_cast<const char *>(data), size);
+  };
+  // magic number of NDArray lists, reserved field, number of arrays
+  uint64_t header[3] = {0x112, 0, arrays.size()};
+  append(header, sizeof(header));
+  for (const auto &array : arrays) {
+    size_t size;
+    const char *data;
+    CHECK_EQ(MXNDArraySaveRawBytes(array.GetHandle(), &size, &data), 0);
+    append(data, size);
+  }
+  uint64_t num_names = names.size();
+  append(&num_names, sizeof(num_names));
+  for (const auto &name : names) {
+    uint64_t length = name.size();
+    append(&length, sizeof(length));
+    append(name.data(), name.size());
+  }
+  return ret;
+}
+}  // namespace private_
+
 NDArray::NDArray() {
   NDArrayHandle handle;
   CHECK_EQ(MXNDArrayCreateNone(&handle), 0);
@@ -32,6 +80,7 @@ NDArray::NDArray(const std::vector<mx_uint> &shape, const Context &context,
                            context.GetDeviceId(), delay_alloc, &handle),
            0);
   blob_ptr_ = std::make_shared<NDBlob>(handle);
+  SetMeta(Shape(shape), context);
 }
 NDArray::NDArray(const Shape &shape, const Context &context, bool delay_alloc) {
   NDArrayHandle handle;
@@ -39,6 +88,18 @@ NDArray::NDArray(const Shape &shape, const Context &context, bool delay_alloc) {
                            context.GetDeviceId(), delay_alloc, &handle),
            0);
   blob_ptr_ = std::make_shared<NDBlob>(handle);
+  SetMeta(shape, context);
+}
+NDArray::NDArray(const Shape &shape, const Context &context, bool delay_alloc,
+                 DType dtype) {
+  NDArrayHandle handle;
+  CHECK_EQ(MXNDArrayCreateEx(shape.data(), shape.ndim(),
+                             context.GetDeviceType(), context.GetDeviceId(),
+                             delay_alloc, dtype, &handle),
+           0);
+  blob_ptr_ = std::make_shared<NDBlob>(handle);
+  SetMeta(shape, context);
+  blob_ptr_->dtype_ = dtype;
 }
 NDArray::NDArray(const mx_float *data, size_t size) {
   NDArrayHandle handle;
@@ -54,6 +115,7 @@ NDArray::NDArray(const mx_float *data, const Shape &shape,
            0);
   MXNDArraySyncCopyFromCPU(handle, data, shape.Size());
   blob_ptr_ = std::make_shared<NDBlob>(handle);
+  SetMeta(shape, context);
 }
 NDArray::NDArray(const std::vector<mx_float> &data, const Shape &shape,
                  const Context &context) {
@@ -63,6 +125,7 @@ NDArray::NDArray(const std::vector<mx_float> &data, const Shape &shape,
            0);
   MXNDArraySyncCopyFromCPU(handle, data.data(), shape.Size());
   blob_ptr_ = std::make_shared<NDBlob>(handle);
+  SetMeta(shape, context);
 }
 NDArray::NDArray(const std::vector<mx_float> &data) {
   NDArrayHandle handle;
@@ -73,8 +136,8 @@ NDArray::NDArray(const std::vector<mx_float> &data) {
 
 NDArray NDArray::operator+(mx_float scalar) {
   NDArray ret;
-  static FunctionHandle func_handle;
-  MXGetFunction("_plus_scalar", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_plus_scalar");
   CHECK_EQ(MXFuncInvoke(func_handle, &blob_ptr_->handle_, &scalar,
                         &ret.blob_ptr_->handle_),
            0);
@@ -82,8 +145,8 @@ NDArray NDArray::operator+(mx_float scalar) {
 }
 NDArray NDArray::operator-(mx_float scalar) {
   NDArray ret;
-  static FunctionHandle func_handle;
-  MXGetFunction("_minus_scalar", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_minus_scalar");
   CHECK_EQ(MXFuncInvoke(func_handle, &blob_ptr_->handle_, &scalar,
                         &ret.blob_ptr_->handle_),
            0);
@@ -91,8 +154,8 @@ NDArray NDArray::operator-(mx_float scalar) {
 }
 NDArray NDArray::operator*(mx_float scalar) {
   NDArray ret;
-  static FunctionHandle func_handle;
-  MXGetFunction("_mul_scalar", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_mul_scalar");
   CHECK_EQ(MXFuncInvoke(func_handle, &blob_ptr_->handle_, &scalar,
                         &ret.blob_ptr_->handle_),
            0);
@@ -100,8 +163,8 @@ NDArray NDArray::operator*(mx_float scalar) {
 }
 NDArray NDArray::operator/(mx_float scalar) {
   NDArray ret;
-  static FunctionHandle func_handle;
-  MXGetFunction("_div_scalar", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_div_scalar");
   CHECK_EQ(MXFuncInvoke(func_handle, &blob_ptr_->handle_, &scalar,
                         &ret.blob_ptr_->handle_),
            0);
@@ -109,8 +172,8 @@ NDArray NDArray::operator/(mx_float scalar) {
 }
 NDArray NDArray::operator+(const NDArray &rhs) {
   NDArray ret;
-  static FunctionHandle func_handle;
-  MXGetFunction("_plus", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_plus");
   NDArrayHandle input_handle[2];
   input_handle[0] = blob_ptr_->handle_;
   input_handle[1] = rhs.blob_ptr_->handle_;
@@ -121,8 +184,8 @@ NDArray NDArray::operator+(const NDArray &rhs) {
 }
 NDArray NDArray::operator-(const NDArray &rhs) {
   NDArray ret;
-  static FunctionHandle func_handle;
-  MXGetFunction("_minus", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_minus");
   NDArrayHandle input_handle[2];
   input_handle[0] = blob_ptr_->handle_;
   input_handle[1] = rhs.blob_ptr_->handle_;
@@ -133,8 +196,8 @@ NDArray NDArray::operator-(const NDArray &rhs) {
 }
 NDArray NDArray::operator*(const NDArray &rhs) {
   NDArray ret;
-  static FunctionHandle func_handle;
-  MXGetFunction("_mul", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_mul");
   NDArrayHandle input_handle[2];
   input_handle[0] = blob_ptr_->handle_;
   input_handle[1] = rhs.blob_ptr_->handle_;
@@ -145,8 +208,8 @@ NDArray NDArray::operator*(const NDArray &rhs) {
 }
 NDArray NDArray::operator/(const NDArray &rhs) {
   NDArray ret;
-  static FunctionHandle func_handle;
-  MXGetFunction("_div", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_div");
   NDArrayHandle input_handle[2];
   input_handle[0] = blob_ptr_->handle_;
   input_handle[1] = rhs.blob_ptr_->handle_;
@@ -156,46 +219,46 @@ NDArray NDArray::operator/(const NDArray &rhs) {
   return ret;
 }
 NDArray &NDArray::operator=(mx_float scalar) {
-  static FunctionHandle func_handle;
-  MXGetFunction("_set_value", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_set_value");
   CHECK_EQ(MXFuncInvoke(func_handle, nullptr, &scalar, &blob_ptr_->handle_), 0);
   return *this;
 }
 NDArray &NDArray::operator+=(mx_float scalar) {
-  static FunctionHandle func_handle;
-  MXGetFunction("_plus_scalar", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_plus_scalar");
   CHECK_EQ(MXFuncInvoke(func_handle, &blob_ptr_->handle_, &scalar,
                         &blob_ptr_->handle_),
            0);
   return *this;
 }
 NDArray &NDArray::operator-=(mx_float scalar) {
-  static FunctionHandle func_handle;
-  MXGetFunction("_minus_scalar", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_minus_scalar");
   CHECK_EQ(MXFuncInvoke(func_handle, &blob_ptr_->handle_, &scalar,
                         &blob_ptr_->handle_),
            0);
   return *this;
 }
 NDArray &NDArray::operator*=(mx_float scalar) {
-  static FunctionHandle func_handle;
-  MXGetFunction("_mul_scalar", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_mul_scalar");
   CHECK_EQ(MXFuncInvoke(func_handle, &blob_ptr_->handle_, &scalar,
                         &blob_ptr_->handle_),
            0);
   return *this;
 }
 NDArray &NDArray::operator/=(mx_float scalar) {
-  static FunctionHandle func_handle;
-  MXGetFunction("_div_scalar", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_div_scalar");
   CHECK_EQ(MXFuncInvoke(func_handle, &blob_ptr_->handle_, &scalar,
                         &blob_ptr_->handle_),
            0);
   return *this;
 }
 NDArray &NDArray::operator+=(const NDArray &rhs) {
-  static FunctionHandle func_handle;
-  MXGetFunction("_plus", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_plus");
   NDArrayHandle input_handle[2];
   input_handle[0] = blob_ptr_->handle_;
   input_handle[1] = rhs.blob_ptr_->handle_;
@@ -204,8 +267,8 @@ NDArray &NDArray::operator+=(const NDArray &rhs) {
   return *this;
 }
 NDArray &NDArray::operator-=(const NDArray &rhs) {
-  static FunctionHandle func_handle;
-  MXGetFunction("_minus", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_minus");
   NDArrayHandle input_handle[2];
   input_handle[0] = blob_ptr_->handle_;
   input_handle[1] = rhs.blob_ptr_->handle_;
@@ -214,8 +277,8 @@ NDArray &NDArray::operator-=(const NDArray &rhs) {
   return *this;
 }
 NDArray &NDArray::operator*=(const NDArray &rhs) {
-  static FunctionHandle func_handle;
-  MXGetFunction("_mul", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_mul");
   NDArrayHandle input_handle[2];
   input_handle[0] = blob_ptr_->handle_;
   input_handle[1] = rhs.blob_ptr_->handle_;
@@ -224,8 +287,8 @@ NDArray &NDArray::operator*=(const NDArray &rhs) {
   return *this;
 }
 NDArray &NDArray::operator/=(const NDArray &rhs) {
-  static FunctionHandle func_handle;
-  MXGetFunction("_div", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_div");
   NDArrayHandle input_handle[2];
   input_handle[0] = blob_ptr_->handle_;
   input_handle[1] = rhs.blob_ptr_->handle_;
@@ -236,8 +299,8 @@ NDArray &NDArray::operator/=(const NDArray &rhs) {
 
 NDArray NDArray::ArgmaxChannel() {
   NDArray ret;
-  static FunctionHandle func_handle;
-  MXGetFunction("argmax_channel", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("argmax_channel");
   CHECK_EQ(MXFuncInvoke(func_handle, &blob_ptr_->handle_, nullptr,
                         &ret.blob_ptr_->handle_),
            0);
@@ -258,18 +321,42 @@ void NDArray::SyncCopyToCPU(std::vector<mx_float> *data, size_t size) {
   data->resize(size);
   MXNDArraySyncCopyToCPU(blob_ptr_->handle_, data->data(), size);
 }
+std::future<void> NDArray::CopyFromCPUAsync(const mx_float *data,
+                                            size_t size) {
+  // nothing waits on a new array, so staging the data does not block, the
+  // copy into this NDArray is then an engine operation on it
+  NDArray staging(GetShapeRef(), Context::cpu(), false);
+  staging.SyncCopyFromCPU(data, size);
+  staging.CopyTo(this);
+  NDArray self = *this;
+  return std::async(std::launch::deferred, [self]() { self.WaitToRead(); });
+}
+std::future<void> NDArray::CopyToCPUAsync(mx_float *data, size_t size) const {
+  NDArray staging(GetShapeRef(), Context::cpu(), false);
+  CopyTo(&staging);
+  size = size > 0 ? size : Size();
+  return std::async(std::launch::deferred, [staging, data, size]() {
+    CHECK_EQ(MXNDArraySyncCopyToCPU(staging.GetHandle(), data, size), 0);
+  });
+}
+std::future<void> NDArray::CopyToCPUAsync(std::vector<mx_float> *data,
+                                          size_t size) const {
+  size = size > 0 ? size : Size();
+  data->resize(size);
+  return CopyToCPUAsync(data->data(), size);
+}
 NDArray NDArray::Copy(const Context &ctx) const {
   NDArray ret(GetShape(), ctx);
-  static FunctionHandle func_handle;
-  MXGetFunction("_copyto", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_copyto");
   CHECK_EQ(MXFuncInvoke(func_handle, &blob_ptr_->handle_, nullptr,
                         &ret.blob_ptr_->handle_),
            0);
   return ret;
 }
 NDArray NDArray::CopyTo(NDArray * other) const {
-  static FunctionHandle func_handle;
-  MXGetFunction("_copyto", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_copyto");
   CHECK_EQ(MXFuncInvoke(func_handle, &blob_ptr_->handle_, nullptr,
                         &other->blob_ptr_->handle_),
            0);
@@ -278,7 +365,15 @@ NDArray NDArray::CopyTo(NDArray * other) const {
 NDArray NDArray::Slice(mx_uint begin, mx_uint end) const {
   NDArrayHandle handle;
   CHECK_EQ(MXNDArraySlice(GetHandle(), begin, end, &handle), 0);
-  return NDArray(handle);
+  NDArray ret(handle);
+  const NDBlob &meta = GetMeta();
+  if (meta.meta_cached_) {
+    Shape shape = meta.shape_;
+    shape[0] = end - begin;
+    ret.SetMeta(shape, meta.context_);
+  }
+  ret.blob_ptr_->dtype_ = blob_ptr_->dtype_.load();
+  return ret;
 }
 NDArray NDArray::Reshape(const Shape &new_shape) const {
   NDArrayHandle handle;
@@ -289,7 +384,10 @@ NDArray NDArray::Reshape(const Shape &new_shape) const {
   new_shape.data();
   CHECK_EQ(
       MXNDArrayReshape(GetHandle(), new_shape.ndim(), dims.data(), &handle), 0);
-  return NDArray(handle);
+  NDArray ret(handle);
+  ret.SetMeta(new_shape, GetContext());
+  ret.blob_ptr_->dtype_ = blob_ptr_->dtype_.load();
+  return ret;
 }
 void NDArray::WaitToRead() const {
   CHECK_EQ(MXNDArrayWaitToRead(blob_ptr_->handle_), 0);
@@ -299,15 +397,15 @@ void NDArray::WaitToWrite() {
 }
 void NDArray::WaitAll() { CHECK_EQ(MXNDArrayWaitAll(), 0); }
 void NDArray::SampleGaussian(mx_float mu, mx_float sigma, NDArray *out) {
-  static FunctionHandle func_handle;
-  MXGetFunction("_random_gaussian", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_random_gaussian");
   mx_float scalar[2] = {mu, sigma};
   CHECK_EQ(MXFuncInvoke(func_handle, nullptr, scalar, &out->blob_ptr_->handle_),
            0);
 }
 void NDArray::SampleUniform(mx_float begin, mx_float end, NDArray *out) {
-  static FunctionHandle func_handle;
-  MXGetFunction("_random_uniform", &func_handle);
+  static FunctionHandle func_handle =
+      private_::GetFunctionHandle("_random_uniform");
   mx_float scalar[2] = {begin, end};
   CHECK_EQ(MXFuncInvoke(func_handle, nullptr, scalar, &out->blob_ptr_->handle_),
            0);
@@ -385,12 +483,26 @@ void NDArray::Save(const std::string &file_name,
            0);
 }
 
+std::string NDArray::SaveToBytes(
+    const std::map<std::string, NDArray> &array_map) {
+  std::vector<NDArray> arrays;
+  std::vector<std::string> names;
+  for (const auto &t : array_map) {
+    arrays.push_back(t.second);
+    names.push_back(t.first);
+  }
+  return private_::SaveToBytes(arrays, names);
+}
+std::string NDArray::SaveToBytes(const std::vector<NDArray> &array_list) {
+  return private_::SaveToBytes(array_list, std::vector<std::string>());
+}
+
 size_t NDArray::Offset(size_t h, size_t w) const {
-  return (h * GetShape()[1]) + w;
+  return (h * GetShapeRef()[1]) + w;
 }
 
 size_t NDArray::Offset(size_t c, size_t h, size_t w) const {
-  auto const shape = GetShape();
+  const Shape &shape = GetShapeRef();
   return h * shape[0] * shape[2] + w * shape[0] + c;
 }
 
@@ -403,33 +515,76 @@ mx_float NDArray::At(size_t c, size_t h, size_t w) const {
 }
 
 size_t NDArray::Size() const {
-  size_t ret = 1;
-  for (auto &i : GetShape()) ret *= i;
-  return ret;
+  return GetShapeRef().Size();
 }
 
 std::vector<mx_uint> NDArray::GetShape() const {
-  const mx_uint *out_pdata;
-  mx_uint out_dim;
-  MXNDArrayGetShape(blob_ptr_->handle_, &out_dim, &out_pdata);
-  std::vector<mx_uint> ret;
-  for (mx_uint i = 0; i < out_dim; ++i) {
-    ret.push_back(out_pdata[i]);
-  }
-  return ret;
+  const Shape &shape = GetShapeRef();
+  return std::vector<mx_uint>(shape.data(), shape.data() + shape.ndim());
+}
+
+const Shape &NDArray::GetShapeRef() const {
+  return GetMeta().shape_;
 }
 
 const mx_float *NDArray::GetData() const {
-  mx_float *ret;
+  mx_float *ret = blob_ptr_->data_.load();
+  if (ret != nullptr) {
+    return ret;
+  }
   CHECK_NE(GetContext().GetDeviceType(), DeviceType::kGPU);
-  MXNDArrayGetData(blob_ptr_->handle_, &ret);
+  CHECK_EQ(MXNDArrayGetData(blob_ptr_->handle_, &ret), 0);
+  blob_ptr_->data_ = ret;
   return ret;
 }
 Context NDArray::GetContext() const {
-  int out_dev_type;
-  int out_dev_id;
-  MXNDArrayGetContext(blob_ptr_->handle_, &out_dev_type, &out_dev_id);
-  return Context((DeviceType)out_dev_type, out_dev_id);
+  return GetMeta().context_;
+}
+
+DType NDArray::GetDType() const {
+  int dtype = blob_ptr_->dtype_.load();
+  if (dtype < 0) {
+    int out_dtype;
+    CHECK_EQ(MXNDArrayGetDType(blob_ptr_->handle_, &out_dtype), 0);
+    // like the shape, the type of a none array is set by its first writer
+    if (GetShapeRef().ndim() == 0) return DType(out_dtype);
+    blob_ptr_->dtype_ = out_dtype;
+    dtype = out_dtype;
+  }
+  return DType(dtype);
+}
+
+void NDArray::SetMeta(const Shape &shape, const Context &context) const {
+  // only called on arrays no other thread can see yet
+  blob_ptr_->shape_ = shape;
+  blob_ptr_->context_ = context;
+  blob_ptr_->meta_cached_.store(true, std::memory_order_release);
+}
+
+const NDBlob &NDArray::GetMeta() const {
+  NDBlob *blob = blob_ptr_.get();
+  if (blob->meta_cached_.load(std::memory_order_acquire)) {
+    return *blob;
+  }
+  std::lock_guard<std::mutex> lock(blob->meta_mutex_);
+  if (blob->meta_cached_.load(std::memory_order_relaxed)) {
+    return *blob;
+  }
+  const mx_uint *out_pdata;
+  mx_uint out_dim;
+  CHECK_EQ(MXNDArrayGetShape(blob->handle_, &out_dim, &out_pdata), 0);
+  // a none array has no context yet, and its shape is set by the first
+  // operation writing it, until then shape_ is left empty
+  if (out_dim > 0) {
+    int out_dev_type;
+    int out_dev_id;
+    CHECK_EQ(MXNDArrayGetContext(blob->handle_, &out_dev_type, &out_dev_id),
+             0);
+    blob->shape_.CopyFrom(out_pdata, out_pdata + out_dim);
+    blob->context_ = Context((DeviceType)out_dev_type, out_dev_id);
+    blob->meta_cached_.store(true, std::memory_order_release);
+  }
+  return *blob;
 }
 }  // namespace cpp
 }  // namespace mxnet
@@ -0,0 +1,321 @@
+/*!
+*  Copyright (c) 2016 by Contributors
+* \file ndarray_loader.h
+* \brief streaming loader of the files of NDArray::Save
+*/
+
+#ifndef MXNETCPP_NDARRAY_LOADER_H
+#define MXNETCPP_NDARRAY_LOADER_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "mxnet-cpp/base.h"
+#include "mxnet-cpp/logging.h"
+#include "mxnet-cpp/ndarray.h"
+#include "mxnet-cpp/ndarray.hpp"
+
+namespace mxnet {
+namespace cpp {
+
+/*!
+* \brief loader of the files written by NDArray::Save, like the .params
+*  checkpoints, and of the bytes of NDArray::SaveToBytes.
+*  The constructor only reads the layout of the file: the shapes, the types
+*  and the names, skipping the data. Load then reads the arrays it is asked
+*  for one at a time, so the others are never read, and the copy of an
+*  array to its device runs on the engine while the next one is read.
+*  The file is mapped in memory when possible, the data is then copied
+*  straight from the page cache into the arrays. The device recorded in the
+*  file is ignored, the arrays are created on the context given to Load,
+*  including its device id.
+*/
+class NDArrayLoader {
+ public:
+  /*!
+  * \param file_name the file
+  * \param use_mmap whether to map the file in memory rather than reading it
+  */
+  explicit NDArrayLoader(const std::string &file_name, bool use_mmap = true)
+      : file_name_(file_name) {
+#ifndef _WIN32
+    if (use_mmap) {
+      Map();
+    }
+#endif
+    if (mapped_ == nullptr) {
+      file_.open(file_name_, std::ios::binary);
+      CHECK(file_) << "Cannot open " << file_name_;
+      file_.seekg(0, std::ios::end);
+      file_size_ = file_.tellg();
+    }
+    ReadLayout();
+  }
+  /*!
+  * \brief load the bytes of NDArray::SaveToBytes
+  * \param data the bytes, like a shared memory segment or an embedded blob
+  * \param size number of bytes
+  * \param context the context of the arrays
+  * \return a map from the names to the arrays
+  */
+  static std::map<std::string, NDArray> LoadFromBytes(
+      const char *data, size_t size, const Context &context = Context::cpu()) {
+    NDArrayLoader loader(Memory(), data, size);
+    return loader.Load("", context);
+  }
+  static std::map<std::string, NDArray> LoadFromBytes(
+      const std::string &bytes, const Context &context = Context::cpu()) {
+    return LoadFromBytes(bytes.data(), bytes.size(), context);
+  }
+  /*!
+  * \brief load the bytes of NDArray::SaveToBytes of a list
+  * \return the arrays in the order they were saved
+  */
+  static std::vector<NDArray> LoadListFromBytes(
+      const char *data, size_t size, const Context &context = Context::cpu()) {
+    NDArrayLoader loader(Memory(), data, size);
+    return loader.LoadToList(context);
+  }
+  static std::vector<NDArray> LoadListFromBytes(
+      const std::string &bytes, const Context &context = Context::cpu()) {
+    return LoadListFromBytes(bytes.data(), bytes.size(), context);
+  }
+  ~NDArrayLoader() {
+#ifndef _WIN32
+    if (mapped_ != nullptr && owns_mapping_) {
+      munmap(const_cast<char *>(mapped_), file_size_);
+    }
+#endif
+  }
+  /*! \return number of arrays in the file */
+  size_t Size() const { return entries_.size(); }
+  /*! \return the names of the arrays, empty if the file has none */
+  const std::vector<std::string> &GetNames() const { return names_; }
+  /*!
+  * \brief load the arrays whose name starts with prefix, like "arg:" or
+  *  "aux:". The arrays are ready to be used by the engine, which waits for
+  *  their copies; wait for them before reading them otherwise.
+  * \param prefix the prefix of the names, "" for all the arrays
+  * \param context the context of the arrays
+  * \param strip_prefix whether to remove the prefix from the names
+  * \return a map from the names to the arrays
+  */
+  std::map<std::string, NDArray> Load(const std::string &prefix,
+                                      const Context &context,
+                                      bool strip_prefix = true) {
+    CHECK_EQ(names_.size(), entries_.size()) << file_name_
+                                             << " has no names";
+    std::map<std::string, NDArray> ret;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      if (names_[i].compare(0, prefix.size(), prefix) != 0) continue;
+      std::string name = strip_prefix ? names_[i].substr(prefix.size())
+                                      : names_[i];
+      ret[name] = LoadArray(entries_[i], context);
+    }
+    return ret;
+  }
+  /*!
+  * \brief load all the arrays, see Load
+  * \param context the context of the arrays
+  * \return the arrays in the order of the file
+  */
+  std::vector<NDArray> LoadToList(const Context &context) {
+    std::vector<NDArray> ret;
+    for (const auto &entry : entries_) {
+      ret.push_back(LoadArray(entry, context));
+    }
+    return ret;
+  }
+
+ private:
+  struct Entry {
+    std::vector<index_t> shape;
+    int dtype;
+    /*! \brief position of the data in the file */
+    size_t offset;
+    /*! \brief size of the data in bytes */
+    size_t size;
+  };
+  /*! \brief magic number of the files of NDArray::Save */
+  static const uint64_t kListMagic = 0x112;
+  /*! \brief magic numbers of the arrays saved by the later versions */
+  static const uint32_t kV1Magic = 0xF993fac8;
+  static const uint32_t kV2Magic = 0xF993fac9;
+  /*! \brief tag of the constructor reading memory */
+  struct Memory {};
+  NDArrayLoader(Memory, const char *data, size_t size)
+      : file_name_("<memory>"), mapped_(data), file_size_(size) {
+    ReadLayout();
+  }
+  NDArrayLoader(const NDArrayLoader &);
+  NDArrayLoader &operator=(const NDArrayLoader &);
+#ifndef _WIN32
+  /*! \brief map the file in memory, mapped_ stays nullptr on failure */
+  void Map() {
+    int fd = open(file_name_.c_str(), O_RDONLY);
+    CHECK_GE(fd, 0) << "Cannot open " << file_name_;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        mapped_ = static_cast<const char *>(addr);
+        file_size_ = st.st_size;
+        owns_mapping_ = true;
+      }
+    }
+    close(fd);
+  }
+#endif
+  /*! \brief copy size bytes at offset of the file into out */
+  void ReadAt(size_t offset, size_t size, void *out) {
+    CHECK_LE(offset + size, file_size_) << file_name_ << " is truncated";
+    if (mapped_ != nullptr) {
+      std::memcpy(out, mapped_ + offset, size);
+    } else {
+      file_.seekg(offset);
+      file_.read(static_cast<char *>(out), size);
+      CHECK(file_) << "Cannot read " << file_name_;
+    }
+  }
+  template <typename T>
+  T Read() {
+    T value;
+    ReadAt(pos_, sizeof(T), &value);
+    pos_ += sizeof(T);
+    return value;
+  }
+  /*! \return size in bytes of an element of dtype */
+  static size_t GetTypeSize(int dtype) {
+    switch (dtype) {
+      case kFloat32: return 4;
+      case kFloat64: return 8;
+      case kFloat16: return 2;
+      case kUint8: return 1;
+      case kInt32: return 4;
+      default: LOG(FATAL) << "Unknown dtype " << dtype;
+    }
+    return 0;
+  }
+  /*!
+  * \brief check that count items of at least item_size bytes each fit in
+  *  the rest of the file
+  */
+  void CheckCount(uint64_t count, size_t item_size) const {
+    CHECK_LE(count, (file_size_ - pos_) / item_size)
+        << file_name_ << " is truncated or corrupted";
+  }
+  /*! \brief read the records of the arrays and the names, not the data */
+  void ReadLayout() {
+    CHECK_EQ(Read<uint64_t>(), kListMagic) << file_name_
+                                           << " is not a NDArray file";
+    Read<uint64_t>();  // reserved
+    // the counts are checked against the rest of the file before anything
+    // is allocated for them
+    uint64_t num_arrays = Read<uint64_t>();
+    CheckCount(num_arrays, sizeof(uint32_t));
+    entries_.resize(num_arrays);
+    for (auto &entry : entries_) {
+      ReadEntry(&entry);
+    }
+    uint64_t num_names = Read<uint64_t>();
+    CheckCount(num_names, sizeof(uint64_t));
+    names_.resize(num_names);
+    for (auto &name : names_) {
+      uint64_t size = Read<uint64_t>();
+      CheckCount(size, 1);
+      name.resize(size);
+      ReadAt(pos_, name.size(), &name[0]);
+      pos_ += name.size();
+    }
+  }
+  void ReadEntry(Entry *entry) {
+    uint32_t magic = Read<uint32_t>();
+    uint32_t ndim = magic;
+    bool wide_dims = false;
+    if (magic == kV1Magic || magic == kV2Magic) {
+      if (magic == kV2Magic) {
+        CHECK_EQ(Read<int32_t>(), 0)
+            << file_name_ << ": only dense arrays are supported";
+      }
+      ndim = Read<uint32_t>();
+      wide_dims = true;
+    }
+    CheckCount(ndim, wide_dims ? sizeof(int64_t) : sizeof(uint32_t));
+    size_t num_elements = 1;
+    entry->shape.resize(ndim);
+    for (auto &dim : entry->shape) {
+      if (wide_dims) {
+        int64_t wide = Read<int64_t>();
+        CHECK(wide >= 0 && wide <= UINT32_MAX) << "Invalid shape";
+        dim = static_cast<index_t>(wide);
+      } else {
+        dim = Read<uint32_t>();
+      }
+      num_elements *= dim;
+    }
+    entry->dtype = kFloat32;
+    entry->offset = pos_;
+    entry->size = 0;
+    if (ndim == 0) return;
+    // the arrays are loaded on the context given to Load instead
+    Read<int32_t>();  // device type
+    Read<int32_t>();  // device id
+    entry->dtype = Read<int32_t>();
+    entry->offset = pos_;
+    entry->size = num_elements * GetTypeSize(entry->dtype);
+    CHECK_LE(pos_ + entry->size, file_size_) << file_name_ << " is truncated";
+    pos_ += entry->size;
+  }
+  /*! \brief read the data of entry into a new array on context */
+  NDArray LoadArray(const Entry &entry, const Context &context) {
+    if (entry.shape.empty()) return NDArray();
+    Shape shape(entry.shape);
+    DType dtype = static_cast<DType>(entry.dtype);
+    NDArray host(shape, Context::cpu(), false, dtype);
+    const char *data;
+    if (mapped_ != nullptr) {
+      data = mapped_ + entry.offset;
+    } else {
+      buffer_.resize(entry.size);
+      ReadAt(entry.offset, entry.size, buffer_.data());
+      data = buffer_.data();
+    }
+    CHECK_EQ(MXNDArraySyncCopyFromCPU(host.GetHandle(), data, shape.Size()),
+             0);
+    if (context.GetDeviceType() == DeviceType::kCPU &&
+        context.GetDeviceId() == 0) {
+      return host;
+    }
+    // the copy runs on the engine while the next array is read
+    NDArray ret(shape, context, false, dtype);
+    host.CopyTo(&ret);
+    return ret;
+  }
+  std::string file_name_;
+  /*! \brief the content of the file, if it is in memory */
+  const char *mapped_ = nullptr;
+  bool owns_mapping_ = false;
+  std::ifstream file_;
+  size_t file_size_ = 0;
+  /*! \brief position of the parsing of the layout */
+  size_t pos_ = 0;
+  std::vector<Entry> entries_;
+  std::vector<std::string> names_;
+  /*! \brief the data read without mmap */
+  std::vector<char> buffer_;
+};
+
+}  // namespace cpp
+}  // namespace mxnet
+
+#endif  // MXNETCPP_NDARRAY_LOADER_H
@@ -0,0 +1,129 @@
+/*!
+*  Copyright (c) 2016 by Contributors
+* \file ndarray_view.h
+* \brief zero-copy host view of a CPU NDArray
+*/
+
+#ifndef MXNETCPP_NDARRAY_VIEW_H
+#define MXNETCPP_NDARRAY_VIEW_H
+
+#include <initializer_list>
+#include <type_traits>
+#include <vector>
+#include "mxnet-cpp/base.h"
+#include "mxnet-cpp/logging.h"
+#include "mxnet-cpp/ndarray.h"
+
+namespace mxnet {
+namespace cpp {
+
+/*!
+* \brief typed, strided view of the memory of a CPU NDArray.
+*  The constructor waits once for the pending operations on the array, then
+*  the elements are accessed in place without copying the whole tensor out.
+*  Use NDArrayView<const mx_float> to read and NDArrayView<mx_float> to
+*  write. The view keeps the array alive, but no other operation on the
+*  array should be pushed while the view is in use.
+*  The views are contiguous: the strides are those of the row-major shape,
+*  and Slice only narrows the first dimension.
+* \tparam DType mx_float or const mx_float
+*/
+template <typename DType>
+class NDArrayView {
+ public:
+  static_assert(
+      std::is_same<typename std::remove_const<DType>::type, mx_float>::value,
+      "NDArrayView only supports mx_float arrays");
+  /*!
+  * \brief construct a view over the whole array
+  * \param array the array to view, must be on a CPU context
+  */
+  explicit NDArrayView(const NDArray &array) : array_(array) {
+    CHECK_NE(array_.GetContext().GetDeviceType(), DeviceType::kGPU)
+        << "NDArrayView needs a CPU NDArray, copy it to Context::cpu() first";
+    CHECK_EQ(array_.GetDType(), kFloat32)
+        << "NDArrayView needs a float32 NDArray";
+    if (std::is_const<DType>::value) {
+      array_.WaitToRead();
+    } else {
+      array_.WaitToWrite();
+    }
+    data_ = const_cast<DType *>(array_.GetData());
+    Init(array_.GetShapeRef());
+  }
+  /*! \return number of dimensions */
+  index_t NDim() const { return shape_.ndim(); }
+  /*! \return the shape of the view */
+  const Shape &GetShape() const { return shape_; }
+  /*! \return number of elements in the view */
+  size_t Size() const { return shape_.Size(); }
+  /*!
+  * \param dim the dimension
+  * \return number of elements between two consecutive indices of dim
+  */
+  size_t Stride(index_t dim) const { return strides_[dim]; }
+  /*! \return pointer to the first element */
+  DType *GetData() const { return data_; }
+  /*! \return pointer to the first element, the view is contiguous */
+  DType *begin() const { return data_; }
+  /*! \return pointer past the last element */
+  DType *end() const { return data_ + Size(); }
+  /*!
+  * \param i position in the flattened view
+  * \return reference to the element
+  */
+  DType &operator[](size_t i) const { return data_[i]; }
+  /*!
+  * \brief access an element by its indices, one per dimension
+  * \return reference to the element
+  */
+  template <typename... Indices>
+  DType &operator()(Indices... indices) const {
+    CHECK_EQ(sizeof...(Indices), shape_.ndim())
+        << "NDArrayView of " << shape_.ndim() << " dimensions indexed by "
+        << sizeof...(Indices) << " indices";
+    size_t offset = 0;
+    index_t dim = 0;
+    for (size_t i : {static_cast<size_t>(indices)...}) {
+      offset += i * strides_[dim++];
+    }
+    return data_[offset];
+  }
+  /*!
+  * \brief view of a range of the first dimension, without copying
+  * \param begin begin index in first dim
+  * \param end end index in first dim
+  * \return the sliced view
+  */
+  NDArrayView Slice(index_t begin, index_t end) const {
+    CHECK_LE(begin, end);
+    CHECK_LE(end, shape_[0]);
+    Shape shape = shape_;
+    shape[0] = end - begin;
+    return NDArrayView(array_, data_ + begin * strides_[0], shape);
+  }
+
+ private:
+  NDArrayView(const NDArray &array, DType *data, const Shape &shape)
+      : array_(array), data_(data) {
+    Init(shape);
+  }
+  void Init(const Shape &shape) {
+    shape_ = shape;
+    strides_.resize(shape_.ndim());
+    size_t stride = 1;
+    for (index_t i = shape_.ndim(); i > 0; --i) {
+      strides_[i - 1] = stride;
+      stride *= shape_[i - 1];
+    }
+  }
+  NDArray array_;
+  DType *data_;
+  Shape shape_;
+  std::vector<size_t> strides_;
+};
+
+}  // namespace cpp
+}  // namespace mxnet
+
+#endif  // MXNETCPP_NDARRAY_VIEW_H
@@ -8,17 +8,23 @@
 #ifndef MXNETCPP_OPTIMIZER_H
 #define MXNETCPP_OPTIMIZER_H
 
+#include <algorithm>
+#include <limits>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 #include "mxnet-cpp/base.h"
 #include "mxnet-cpp/logging.h"
+#include "mxnet-cpp/lr_scheduler.h"
 #include "mxnet-cpp/ndarray.h"
 
 namespace mxnet {
 namespace cpp {
 
 /*!
-* \brief Optimizer interface
+* \brief Optimizer interface, the base class runs the optimizers registered
+*  in the backend, see Create for the ones implemented in C++
 */
 class Optimizer {
  public:
@@ -33,10 +39,21 @@ class Optimizer {
   /*!
   * \brief destructor, free the handle
   */
-  ~Optimizer() {
+  virtual ~Optimizer() {
     if (init_) MXOptimizerFree(handle_);
   }
   /*!
+  * \brief create an optimizer, implemented in C++ for the CPU weights if
+  *  opt_type is one of "sgd", "adam" and "rmsprop", run by the backend
+  *  otherwise
+  * \param opt_type type of the optimizer
+  * \param learning_rate
+  * \param weight_decay
+  * \return the new optimizer, which need to be free manually
+  */
+  static Optimizer *Create(const std::string &opt_type,
+                           mx_float learning_rate, mx_float weight_decay);
+  /*!
   * \brief set config parameters
   * \param name name of the config parameter
   * \param value value of the config parameter
@@ -53,6 +70,30 @@ class Optimizer {
     return *this;
   }
   /*!
+  * \brief set the learning rate scheduler, which then overrides the learning
+  *  rate passed to Update. Its schedule starts from the learning rate of
+  *  the optimizer, unless one was set with LRScheduler::SetLR, and
+  *  advances with the number of updates of the weight updated the most
+  * \param lr_scheduler the scheduler
+  * \return reference of self
+  */
+  Optimizer &SetLRScheduler(std::unique_ptr<LRScheduler> lr_scheduler);
+  /*!
+  * \brief keep float32 master copies of the weights of other types, such as
+  *  float16 weights of an executor. The master weights are updated with the
+  *  gradients cast to float32 and then cast back into the weights
+  * \param multi_precision whether to keep master weights
+  * \return reference of self
+  */
+  Optimizer &SetMultiPrecision(bool multi_precision);
+  /*!
+  * \brief set the scale the loss was multiplied with, the gradients are
+  *  divided by it before the update, see LossScaler
+  * \param loss_scale the scale of the loss
+  * \return reference of self
+  */
+  Optimizer &SetLossScale(mx_float loss_scale);
+  /*!
   *  \brief Update a weight with gradient.
   *  \param index the unique index for the weight.
   *  \param weight the weight to update.
@@ -69,10 +110,27 @@ class Optimizer {
   *  \param grad gradient for the weight.
   */
   void Update(int index, NDArray weight, NDArray grad);
-  // TODO(zhangcheng-qinyinghua)
-  // implement Update a list of arrays, maybe in the form of map
-  // void Update(int index, std::vector<NDArray> weights, std::vector<NDArray>
-  // grad, mx_float lr);
+  /*!
+  *  \brief Update a list of weights with their gradients at once.
+  *  \param indices the unique indices for the weights.
+  *  \param weights the weights to update.
+  *  \param grads gradients for the weights.
+  *  \param learning_rate learning rate.
+  *  \param weight_decay weight decay.
+  */
+  void Update(const std::vector<int> &indices,
+              const std::vector<NDArray> &weights,
+              const std::vector<NDArray> &grads, mx_float learning_rate,
+              mx_float weight_decay);
+  /*!
+  *  \brief Update a list of weights with their gradients at once.
+  *  \param indices the unique indices for the weights.
+  *  \param weights the weights to update.
+  *  \param grads gradients for the weights.
+  */
+  void Update(const std::vector<int> &indices,
+              const std::vector<NDArray> &weights,
+              const std::vector<NDArray> &grads);
 
   /*!
   *  \brief Serialize the optimizer parameters to a string.
@@ -80,15 +138,233 @@ class Optimizer {
   */
   std::string Serialize() const;
 
- private:
-  bool init_;
+ protected:
+  /*!
+  * \brief update float32 weights, once the learning rate is scheduled
+  * \param indices the unique indices for the weights
+  * \param weights the weights to update
+  * \param grads gradients for the weights
+  * \param lr learning rate
+  * \param wd weight decay
+  * \param rescale factor to apply to the gradients first
+  */
+  virtual void UpdateImpl(const std::vector<int> &indices,
+                          const std::vector<NDArray> &weights,
+                          const std::vector<NDArray> &grads, mx_float lr,
+                          mx_float wd, mx_float rescale);
+  /*!
+  * \param name name of the config parameter
+  * \param default_value returned if the parameter is not set
+  * \return value of the config parameter
+  */
+  mx_float GetParam(const std::string &name, mx_float default_value) const;
   mx_float learning_rate_, weight_decay_;
   std::string opt_type_;
+  std::map<std::string, std::string> params_;
+
+ private:
+  /*! \brief float32 copies of a weight of another type and its gradient */
+  struct Master {
+    NDArray weight, grad;
+  };
+  /*!
+  * \brief count an update of a weight
+  * \param index the unique index for the weight
+  */
+  void IncreaseCount(int index);
+  /*!
+  * \param learning_rate the learning rate passed to Update
+  * \return the learning rate of the scheduler if any, learning_rate otherwise
+  */
+  mx_float GetLR(mx_float learning_rate) const {
+    return lr_scheduler_ ? lr_scheduler_->GetLR(num_update_) : learning_rate;
+  }
+  std::unique_ptr<LRScheduler> lr_scheduler_;
+  bool multi_precision_;
+  std::map<int, Master> masters_;
+  mx_float loss_scale_;
+  /*! \brief the rescaled gradients of the weights, see UpdateImpl */
+  std::map<int, NDArray> rescaled_grads_;
+  /*! \brief number of updates of each weight */
+  std::map<int, unsigned> count_;
+  /*! \brief the largest number of updates of a weight */
+  unsigned num_update_;
+  /*! \brief create the backend optimizer with params_ */
+  void Init();
+  bool init_;
   Optimizer(const Optimizer &);
   Optimizer &operator=(const Optimizer &);
   OptimizerHandle handle_;
-  OptimizerCreator creator_;
-  std::map<std::string, std::string> params_;
+};
+
+/*!
+* \brief base of the optimizers implemented in C++ on CPU NDArrays.
+*  The update runs on the calling thread, directly on the memory of the
+*  arrays, once the pending operations on them are done. The weights on
+*  other devices, such as GPUs, are updated by the backend optimizer of the
+*  same type instead. Each element goes
+*  through a single fused pass: rescale_grad, clip_gradient, weight decay
+*  and the update rule. The state of all the weights lives in one
+*  contiguous arena, and the weights of a batched Update are processed in
+*  parallel with OpenMP.
+*/
+class NativeOptimizer : public Optimizer {
+ protected:
+  /*!
+  * \param opt_type type of the optimizer
+  * \param learning_rate
+  * \param weight_decay
+  * \param num_state number of state elements per weight element
+  */
+  NativeOptimizer(const std::string &opt_type, mx_float learning_rate,
+                  mx_float weight_decay, int num_state);
+  void UpdateImpl(const std::vector<int> &indices,
+                  const std::vector<NDArray> &weights,
+                  const std::vector<NDArray> &grads, mx_float lr, mx_float wd,
+                  mx_float rescale);
+  /*! \brief read the config parameters, called before the first update */
+  virtual void ReadParams();
+  /*!
+  * \brief update a weight in place
+  * \param weight the weight
+  * \param grad the gradient
+  * \param state num_state arrays of size elements, zero at the beginning
+  * \param size number of elements
+  * \param num_update number of updates of this weight, including this one
+  * \param rescale factor to apply to the gradient first
+  * \param lr learning rate
+  * \param wd weight decay
+  */
+  virtual void Step(mx_float *weight, const mx_float *grad, mx_float *state,
+                    size_t size, int num_update, mx_float rescale,
+                    mx_float lr, mx_float wd) const = 0;
+  /*!
+  * \brief branch free so that the loops calling it are vectorized
+  * \return the gradient after rescaling, clipping and weight decay
+  */
+  static mx_float Preprocess(mx_float grad, mx_float weight, mx_float rescale,
+                             mx_float clip, mx_float wd) {
+    return std::min(std::max(grad * rescale, -clip), clip) + wd * weight;
+  }
+  mx_float rescale_grad_;
+  /*! \brief bound of the gradient, infinity if clipping is disabled */
+  mx_float clip_gradient_;
+
+ private:
+  /*! \brief location of the state of a weight in the arena */
+  struct State {
+    size_t offset;
+    size_t size;
+    int num_update;
+  };
+  /*! \brief find or allocate the state of a weight */
+  State *GetState(int index, size_t size);
+  int num_state_;
+  bool params_read_;
+  std::map<int, State> states_;
+  std::vector<mx_float> arena_;
+};
+
+/*!
+* \brief stochastic gradient descent with momentum, config parameters:
+*  momentum (0), rescale_grad (1), clip_gradient (disabled)
+*/
+class SGDOptimizer : public NativeOptimizer {
+ public:
+  SGDOptimizer(mx_float learning_rate, mx_float weight_decay);
+
+ protected:
+  void ReadParams();
+  void Step(mx_float *weight, const mx_float *grad, mx_float *state,
+            size_t size, int num_update, mx_float rescale, mx_float lr,
+            mx_float wd) const;
+
+ private:
+  mx_float momentum_;
+};
+
+/*!
+* \brief Adam, config parameters: beta1 (0.9), beta2 (0.999), epsilon (1e-8),
+*  rescale_grad (1), clip_gradient (disabled)
+*/
+class AdamOptimizer : public NativeOptimizer {
+ public:
+  AdamOptimizer(mx_float learning_rate, mx_float weight_decay);
+
+ protected:
+  void ReadParams();
+  void Step(mx_float *weight, const mx_float *grad, mx_float *state,
+            size_t size, int num_update, mx_float rescale, mx_float lr,
+            mx_float wd) const;
+
+ private:
+  mx_float beta1_, beta2_, epsilon_;
+};
+
+/*!
+* \brief RMSProp, config parameters: gamma1 (0.9), the decay of the moving
+*  average of the squared gradient, epsilon (1e-8), rescale_grad (1),
+*  clip_gradient (disabled)
+*/
+class RMSPropOptimizer : public NativeOptimizer {
+ public:
+  RMSPropOptimizer(mx_float learning_rate, mx_float weight_decay);
+
+ protected:
+  void ReadParams();
+  void Step(mx_float *weight, const mx_float *grad, mx_float *state,
+            size_t size, int num_update, mx_float rescale, mx_float lr,
+            mx_float wd) const;
+
+ private:
+  mx_float gamma1_, epsilon_;
+};
+
+/*!
+* \brief dynamic loss scaling for float16 training. The loss, or the head
+*  gradients, are multiplied by GetScale so that small gradients do not
+*  underflow in float16. Step skips the updates whose gradients overflowed
+*  and divides the scale by factor, and multiplies the scale by factor after
+*  window steps without overflow.
+*/
+class LossScaler {
+ public:
+  /*!
+  * \param init_scale the initial scale
+  * \param factor the factor the scale changes by
+  * \param window number of steps without overflow before increasing the
+  *  scale, 0 for a static scale, in which case no overflow is checked
+  */
+  explicit LossScaler(mx_float init_scale = 65536, mx_float factor = 2,
+                      unsigned window = 2000);
+  /*! \return the scale to multiply the loss with */
+  mx_float GetScale() const { return scale_; }
+  /*!
+  * \brief update the weights with opt unless the gradients overflowed
+  * \param opt the optimizer
+  * \param indices the unique indices for the weights
+  * \param weights the weights to update
+  * \param grads gradients for the weights, of the scaled loss
+  * \param learning_rate learning rate
+  * \param weight_decay weight decay
+  * \return whether the weights were updated
+  */
+  bool Step(Optimizer *opt, const std::vector<int> &indices,
+            const std::vector<NDArray> &weights,
+            const std::vector<NDArray> &grads, mx_float learning_rate,
+            mx_float weight_decay);
+
+ private:
+  /*! \return whether all the gradients are finite */
+  bool AllFinite(const std::vector<NDArray> &grads);
+  mx_float scale_, factor_;
+  unsigned window_, num_good_;
+  /*! \brief float32 copies of the gradients of other types */
+  std::vector<NDArray> casts_;
+  /*! \brief the float32 norms of the gradients, on their devices */
+  std::vector<NDArray> norms_;
+  /*! \brief the norms gathered for a single host read */
+  NDArray host_norms_;
 };
 }  // namespace cpp
 }  // namespace mxnet
@@ -8,54 +8,409 @@
 #ifndef MXNETCPP_OPTIMIZER_HPP
 #define MXNETCPP_OPTIMIZER_HPP
 
+#include <algorithm>
+#include <cmath>
 #include <numeric>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include "mxnet-cpp/optimizer.h"
+#include "mxnet-cpp/ndarray.hpp"
+#include "mxnet-cpp/ndarray_view.h"
 
 namespace mxnet {
 namespace cpp {
 
 Optimizer::Optimizer(const std::string &opt_type, mx_float learning_rate, mx_float weight_decay)
-  :init_(false), learning_rate_(learning_rate), weight_decay_(weight_decay), opt_type_(opt_type) {
-  MXOptimizerFindCreator(opt_type.c_str(), &creator_);
+  : learning_rate_(learning_rate), weight_decay_(weight_decay), opt_type_(opt_type),
+    multi_precision_(false), loss_scale_(1), num_update_(0), init_(false) {}
+
+Optimizer &Optimizer::SetLRScheduler(std::unique_ptr<LRScheduler> lr_scheduler) {
+  lr_scheduler_ = std::move(lr_scheduler);
+  // keep the learning rate of a deserialized scheduler, which is more
+  // precise than the serialized learning rate of the optimizer
+  if (!lr_scheduler_->HasLR()) {
+    lr_scheduler_->SetLR(learning_rate_);
+  }
+  return *this;
+}
+
+Optimizer &Optimizer::SetMultiPrecision(bool multi_precision) {
+  multi_precision_ = multi_precision;
+  return *this;
+}
+
+Optimizer &Optimizer::SetLossScale(mx_float loss_scale) {
+  CHECK_GT(loss_scale, 0);
+  loss_scale_ = loss_scale;
+  return *this;
+}
+
+void Optimizer::IncreaseCount(int index) {
+  unsigned count = ++count_[index];
+  num_update_ = std::max(num_update_, count);
+}
+
+void Optimizer::Init() {
+  OptimizerCreator creator;
+  CHECK_EQ(MXOptimizerFindCreator(opt_type_.c_str(), &creator), 0);
+  std::vector<const char *> param_keys;
+  std::vector<const char *> param_values;
+  for (const auto &k_v : params_) {
+    param_keys.push_back(k_v.first.c_str());
+    param_values.push_back(k_v.second.c_str());
+  }
+  MXOptimizerCreateOptimizer(creator, params_.size(), param_keys.data(),
+                             param_values.data(), &handle_);
+  init_ = true;
 }
 
 void Optimizer::Update(int index, NDArray weight, NDArray grad, mx_float learning_rate,
                        mx_float weight_decay) {
-  if (!init_) {
-    std::vector<const char *> param_keys;
-    std::vector<const char *> param_values;
-    for (const auto &k_v : params_) {
-      param_keys.push_back(k_v.first.c_str());
-      param_values.push_back(k_v.second.c_str());
-    }
-    MXOptimizerCreateOptimizer(creator_, params_.size(), param_keys.data(),
-                               param_values.data(), &handle_);
-    init_ = true;
-  }
-  learning_rate_ = learning_rate;
-  weight_decay_ = weight_decay;
-  MXOptimizerUpdate(handle_, index, weight.GetHandle(), grad.GetHandle(),
-      learning_rate_, weight_decay_);
+  Update(std::vector<int>(1, index), std::vector<NDArray>(1, weight),
+         std::vector<NDArray>(1, grad), learning_rate, weight_decay);
 }
 
 void Optimizer::Update(int index, NDArray weight, NDArray grad) {
   Update(index, weight, grad, learning_rate_, weight_decay_);
 }
 
+void Optimizer::Update(const std::vector<int> &indices,
+                       const std::vector<NDArray> &weights,
+                       const std::vector<NDArray> &grads,
+                       mx_float learning_rate, mx_float weight_decay) {
+  CHECK_EQ(indices.size(), weights.size());
+  CHECK_EQ(indices.size(), grads.size());
+  learning_rate_ = learning_rate;
+  weight_decay_ = weight_decay;
+  for (int index : indices) {
+    IncreaseCount(index);
+  }
+  mx_float lr = GetLR(learning_rate_);
+  mx_float rescale = 1 / loss_scale_;
+  if (!multi_precision_) {
+    UpdateImpl(indices, weights, grads, lr, weight_decay_, rescale);
+    return;
+  }
+  // update float32 copies of the other weights, then cast them back
+  std::vector<NDArray> master_weights(weights), master_grads(grads);
+  std::vector<size_t> cast_back;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    if (weights[i].GetDType() == kFloat32) continue;
+    auto it = masters_.find(indices[i]);
+    if (it == masters_.end()) {
+      const Shape &shape = weights[i].GetShapeRef();
+      Context context = weights[i].GetContext();
+      Master master = {NDArray(shape, context, false, kFloat32),
+                       NDArray(shape, context, false, kFloat32)};
+      weights[i].CopyTo(&master.weight);
+      it = masters_.emplace(indices[i], master).first;
+    }
+    grads[i].CopyTo(&it->second.grad);
+    master_weights[i] = it->second.weight;
+    master_grads[i] = it->second.grad;
+    cast_back.push_back(i);
+  }
+  UpdateImpl(indices, master_weights, master_grads, lr, weight_decay_,
+             rescale);
+  for (size_t i : cast_back) {
+    NDArray weight = weights[i];
+    master_weights[i].CopyTo(&weight);
+  }
+}
+
+void Optimizer::UpdateImpl(const std::vector<int> &indices,
+                           const std::vector<NDArray> &weights,
+                           const std::vector<NDArray> &grads, mx_float lr,
+                           mx_float wd, mx_float rescale) {
+  if (!init_) Init();
+  // the backend takes one weight per call, the lists are walked without
+  // copying any NDArray
+  static FunctionHandle mul_scalar =
+      private_::GetFunctionHandle("_mul_scalar");
+  for (size_t i = 0; i < indices.size(); ++i) {
+    NDArrayHandle grad = grads[i].GetHandle();
+    if (rescale != 1) {
+      // the gradients of the caller may be accumulated into, they are
+      // scaled into a buffer kept for each weight
+      NDArray &rescaled = rescaled_grads_[indices[i]];
+      if (rescaled.GetShapeRef() != grads[i].GetShapeRef() ||
+          rescaled.GetDType() != grads[i].GetDType()) {
+        rescaled = NDArray(grads[i].GetShapeRef(), grads[i].GetContext(),
+                           false, grads[i].GetDType());
+      }
+      NDArrayHandle out = rescaled.GetHandle();
+      CHECK_EQ(MXFuncInvoke(mul_scalar, &grad, &rescale, &out), 0);
+      grad = out;
+    }
+    CHECK_EQ(MXOptimizerUpdate(handle_, indices[i], weights[i].GetHandle(),
+                               grad, lr, wd), 0);
+  }
+}
+
+void Optimizer::Update(const std::vector<int> &indices,
+                       const std::vector<NDArray> &weights,
+                       const std::vector<NDArray> &grads) {
+  Update(indices, weights, grads, learning_rate_, weight_decay_);
+}
+
 std::string Optimizer::Serialize() const {
   using ValueType = std::map<std::string, std::string>::value_type;
   auto params = params_;
   params.emplace("opt_type", opt_type_);
   params.emplace("learning_rate", std::to_string(learning_rate_));
   params.emplace("weight_decay", std::to_string(weight_decay_));
+  if (lr_scheduler_) {
+    params.emplace("lr_scheduler", lr_scheduler_->Serialize());
+  }
   return std::accumulate(params.cbegin(), params.cend(), std::string(""),
     [](const std::string& sum, const ValueType& i) {
       return sum + '\n' + i.first + '=' + i.second;
     }).substr(1);
 }
+
+mx_float Optimizer::GetParam(const std::string &name,
+                             mx_float default_value) const {
+  auto it = params_.find(name);
+  return it == params_.end() ? default_value : std::stof(it->second);
+}
+
+NativeOptimizer::NativeOptimizer(const std::string &opt_type,
+                                 mx_float learning_rate, mx_float weight_decay,
+                                 int num_state)
+    : Optimizer(opt_type, learning_rate, weight_decay),
+      rescale_grad_(1),
+      clip_gradient_(std::numeric_limits<mx_float>::infinity()),
+      num_state_(num_state),
+      params_read_(false) {}
+
+void NativeOptimizer::ReadParams() {
+  rescale_grad_ = GetParam("rescale_grad", 1);
+  clip_gradient_ = GetParam("clip_gradient", -1);
+  if (clip_gradient_ <= 0) {
+    clip_gradient_ = std::numeric_limits<mx_float>::infinity();
+  }
+}
+
+NativeOptimizer::State *NativeOptimizer::GetState(int index, size_t size) {
+  auto it = states_.find(index);
+  if (it == states_.end()) {
+    State state = {arena_.size(), size, 0};
+    arena_.resize(arena_.size() + num_state_ * size, 0);
+    it = states_.emplace(index, state).first;
+  }
+  CHECK_EQ(it->second.size, size) << "size of weight " << index << " changed";
+  ++it->second.num_update;
+  return &it->second;
+}
+
+void NativeOptimizer::UpdateImpl(const std::vector<int> &indices,
+                                 const std::vector<NDArray> &weights,
+                                 const std::vector<NDArray> &grads,
+                                 mx_float lr, mx_float wd, mx_float rescale) {
+  if (!params_read_) {
+    ReadParams();
+    params_read_ = true;
+  }
+  // the weights on other devices are left to the backend optimizer of the
+  // same type, which runs there without copying them to the host
+  std::vector<int> device_indices;
+  std::vector<NDArray> device_weights, device_grads;
+  // wait for all the arrays and grow the arena before any update starts
+  std::vector<NDArrayView<mx_float> > w;
+  std::vector<NDArrayView<const mx_float> > g;
+  std::vector<State *> states;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    if (weights[i].GetContext().GetDeviceType() == DeviceType::kGPU ||
+        grads[i].GetContext().GetDeviceType() == DeviceType::kGPU) {
+      device_indices.push_back(indices[i]);
+      device_weights.push_back(weights[i]);
+      device_grads.push_back(grads[i]);
+      continue;
+    }
+    w.emplace_back(weights[i]);
+    g.emplace_back(grads[i]);
+    CHECK_EQ(w.back().Size(), g.back().Size());
+    states.push_back(GetState(indices[i], w.back().Size()));
+  }
+  if (!device_indices.empty()) {
+    Optimizer::UpdateImpl(device_indices, device_weights, device_grads, lr,
+                          wd, rescale);
+  }
+  rescale *= rescale_grad_;
+  int num = w.size();
+  #pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < num; ++i) {
+    Step(w[i].GetData(), g[i].GetData(), arena_.data() + states[i]->offset,
+         w[i].Size(), states[i]->num_update, rescale, lr, wd);
+  }
+}
+
+SGDOptimizer::SGDOptimizer(mx_float learning_rate, mx_float weight_decay)
+    : NativeOptimizer("sgd", learning_rate, weight_decay, 1), momentum_(0) {}
+
+void SGDOptimizer::ReadParams() {
+  NativeOptimizer::ReadParams();
+  momentum_ = GetParam("momentum", 0);
+}
+
+void SGDOptimizer::Step(mx_float *weight, const mx_float *grad,
+                        mx_float *state, size_t size, int num_update,
+                        mx_float rescale, mx_float lr, mx_float wd) const {
+  mx_float *__restrict w = weight;
+  const mx_float *__restrict g = grad;
+  mx_float *__restrict mom = state;
+  // locals, the compiler cannot tell the members from the weights
+  const mx_float clip = clip_gradient_;
+  const mx_float momentum = momentum_;
+  if (momentum > 0) {
+    for (size_t i = 0; i < size; ++i) {
+      mx_float grad_i = Preprocess(g[i], w[i], rescale, clip, wd);
+      mom[i] = momentum * mom[i] - lr * grad_i;
+      w[i] += mom[i];
+    }
+  } else {
+    for (size_t i = 0; i < size; ++i) {
+      w[i] -= lr * Preprocess(g[i], w[i], rescale, clip, wd);
+    }
+  }
+}
+
+AdamOptimizer::AdamOptimizer(mx_float learning_rate, mx_float weight_decay)
+    : NativeOptimizer("adam", learning_rate, weight_decay, 2),
+      beta1_(0.9),
+      beta2_(0.999),
+      epsilon_(1e-8) {}
+
+void AdamOptimizer::ReadParams() {
+  NativeOptimizer::ReadParams();
+  beta1_ = GetParam("beta1", 0.9);
+  beta2_ = GetParam("beta2", 0.999);
+  epsilon_ = GetParam("epsilon", 1e-8);
+}
+
+void AdamOptimizer::Step(mx_float *weight, const mx_float *grad,
+                         mx_float *state, size_t size, int num_update,
+                         mx_float rescale, mx_float lr, mx_float wd) const {
+  mx_float *__restrict w = weight;
+  const mx_float *__restrict g = grad;
+  mx_float *__restrict mean = state;
+  mx_float *__restrict var = state + size;
+  const mx_float clip = clip_gradient_;
+  const mx_float beta1 = beta1_, beta2 = beta2_, epsilon = epsilon_;
+  // bias correction of both moments folded into the learning rate
+  const mx_float lr_t = lr * std::sqrt(1 - std::pow(beta2, num_update)) /
+                        (1 - std::pow(beta1, num_update));
+  for (size_t i = 0; i < size; ++i) {
+    mx_float grad_i = Preprocess(g[i], w[i], rescale, clip, wd);
+    mean[i] = beta1 * mean[i] + (1 - beta1) * grad_i;
+    var[i] = beta2 * var[i] + (1 - beta2) * grad_i * grad_i;
+    w[i] -= lr_t * mean[i] / (std::sqrt(var[i]) + epsilon);
+  }
+}
+
+RMSPropOptimizer::RMSPropOptimizer(mx_float learning_rate,
+                                   mx_float weight_decay)
+    : NativeOptimizer("rmsprop", learning_rate, weight_decay, 1),
+      gamma1_(0.9),
+      epsilon_(1e-8) {}
+
+void RMSPropOptimizer::ReadParams() {
+  NativeOptimizer::ReadParams();
+  gamma1_ = GetParam("gamma1", 0.9);
+  epsilon_ = GetParam("epsilon", 1e-8);
+}
+
+void RMSPropOptimizer::Step(mx_float *weight, const mx_float *grad,
+                            mx_float *state, size_t size, int num_update,
+                            mx_float rescale, mx_float lr,
+                            mx_float wd) const {
+  mx_float *__restrict w = weight;
+  const mx_float *__restrict g = grad;
+  mx_float *__restrict n = state;
+  const mx_float clip = clip_gradient_;
+  const mx_float gamma1 = gamma1_, epsilon = epsilon_;
+  for (size_t i = 0; i < size; ++i) {
+    mx_float grad_i = Preprocess(g[i], w[i], rescale, clip, wd);
+    n[i] = gamma1 * n[i] + (1 - gamma1) * grad_i * grad_i;
+    w[i] -= lr * grad_i / std::sqrt(n[i] + epsilon);
+  }
+}
+
+Optimizer *Optimizer::Create(const std::string &opt_type,
+                             mx_float learning_rate, mx_float weight_decay) {
+  if (opt_type == "sgd") {
+    return new SGDOptimizer(learning_rate, weight_decay);
+  } else if (opt_type == "adam") {
+    return new AdamOptimizer(learning_rate, weight_decay);
+  } else if (opt_type == "rmsprop") {
+    return new RMSPropOptimizer(learning_rate, weight_decay);
+  }
+  return new Optimizer(opt_type, learning_rate, weight_decay);
+}
+
+LossScaler::LossScaler(mx_float init_scale, mx_float factor, unsigned window)
+    : scale_(init_scale), factor_(factor), window_(window), num_good_(0) {
+  CHECK_GT(scale_, 0);
+  CHECK_GT(factor_, 1);
+}
+
+bool LossScaler::Step(Optimizer *opt, const std::vector<int> &indices,
+                      const std::vector<NDArray> &weights,
+                      const std::vector<NDArray> &grads,
+                      mx_float learning_rate, mx_float weight_decay) {
+  if (window_ != 0 && !AllFinite(grads)) {
+    scale_ /= factor_;
+    num_good_ = 0;
+    return false;
+  }
+  opt->SetLossScale(scale_);
+  opt->Update(indices, weights, grads, learning_rate, weight_decay);
+  if (window_ != 0 && ++num_good_ == window_) {
+    scale_ *= factor_;
+    num_good_ = 0;
+  }
+  return true;
+}
+
+bool LossScaler::AllFinite(const std::vector<NDArray> &grads) {
+  static FunctionHandle norm = private_::GetFunctionHandle("norm");
+  if (norms_.size() != grads.size()) {
+    casts_.assign(grads.size(), NDArray());
+    norms_.clear();
+    for (const auto &grad : grads) {
+      norms_.emplace_back(Shape(1), grad.GetContext(), false, kFloat32);
+    }
+    host_norms_ = NDArray(Shape(grads.size()), Context::cpu(), false,
+                          kFloat32);
+  }
+  // a single wait for all the norms instead of one per gradient
+  for (size_t i = 0; i < grads.size(); ++i) {
+    NDArray grad = grads[i];
+    // the norm of a float16 gradient overflows long before its elements
+    // do, it is computed in float32 on the device
+    if (grad.GetDType() != kFloat32) {
+      if (casts_[i].GetShapeRef() != grad.GetShapeRef()) {
+        casts_[i] =
+            NDArray(grad.GetShapeRef(), grad.GetContext(), false, kFloat32);
+      }
+      grad.CopyTo(&casts_[i]);
+      grad = casts_[i];
+    }
+    NDArrayHandle in = grad.GetHandle();
+    NDArrayHandle out = norms_[i].GetHandle();
+    CHECK_EQ(MXFuncInvoke(norm, &in, nullptr, &out), 0);
+    NDArray host_norm = host_norms_.Slice(i, i + 1);
+    norms_[i].CopyTo(&host_norm);
+  }
+  NDArrayView<const mx_float> view(host_norms_);
+  for (mx_float value : view) {
+    if (!std::isfinite(value)) return false;
+  }
+  return true;
+}
+
 }  // namespace cpp
 }  // namespace mxnet
 
@@ -0,0 +1,101 @@
+/*!
+*  Copyright (c) 2016 by Contributors
+* \file trainer.h
+* \brief data parallel training of an executor through a kvstore
+*/
+
+#ifndef MXNETCPP_TRAINER_H
+#define MXNETCPP_TRAINER_H
+
+#include <memory>
+#include <vector>
+#include "mxnet-cpp/base.h"
+#include "mxnet-cpp/executor.h"
+#include "mxnet-cpp/kvstore.h"
+
+namespace mxnet {
+namespace cpp {
+
+/*!
+* \brief trains the parameters of an executor through a kvstore, with the
+*  communication overlapped with the computation.
+*  Backward queues the push and the pull of every gradient without waiting:
+*  the engine starts the push of a gradient as soon as the backward pass
+*  has written it, while the gradients of the earlier layers are still
+*  computed, and the next Forward only waits for the pull of the weights it
+*  reads. The last layers are pushed first, since backward produces their
+*  gradients first, and the earlier layers get the higher priorities, so
+*  their weights are pulled first for the next forward pass.
+*
+*  The parameter at position i of arg_arrays is stored under the key i,
+*  the kvstore should have an optimizer, see KVStore::SetOptimizer. With
+*  several executors, the gradients of a key are summed by the kvstore and
+*  the updated parameter is pulled into every executor.
+*
+*  With an optimizer given to SetOptimizer instead, the kvstore only sums
+*  the gradients, which are pulled back into grad_arrays, and all the
+*  parameters of all the executors are then updated by a single batched
+*  Update on the calling thread.
+*/
+class KVStoreTrainer {
+ public:
+  /*!
+  * \param exec the executor, bound with the gradients of the parameters
+  * \param kvstore the kvstore
+  * \param arg_update_begin begin index of the arguments to be trained, it
+  *  starts after the input data by default
+  * \param arg_update_end end index of the arguments to be trained, it ends
+  *  before the label data by default
+  */
+  KVStoreTrainer(Executor *exec, KVStore *kvstore, int arg_update_begin = 1,
+                 int arg_update_end = -1);
+  /*!
+  * \param execs executors of the same symbol, one per device
+  * \param kvstore the kvstore
+  * \param arg_indices the positions in arg_arrays of the arguments to be
+  *  trained
+  */
+  KVStoreTrainer(const std::vector<Executor *> &execs, KVStore *kvstore,
+                 const std::vector<int> &arg_indices);
+  /*!
+  * \brief initialize the kvstore with the parameters of the executor, and
+  *  pull them back so that all the workers start from the same values
+  */
+  void Init();
+  /*!
+  * \brief run the backward pass and queue the push and the pull of all
+  *  the gradients, the call does not wait for any of them
+  * \param head_grads the gradient of head nodes, see Executor::Backward,
+  *  given to all the executors
+  */
+  void Backward(const std::vector<NDArray> &head_grads =
+                    std::vector<NDArray>());
+  /*!
+  * \brief queue the push of all the gradients and the pull of the updated
+  *  parameters, called by Backward
+  */
+  void PushPull();
+  /*!
+  * \brief update the parameters with optimizer after the gradients are
+  *  summed, rather than with the optimizer of the kvstore. The copy of key
+  *  i in executor j is the weight i * execs.size() + j of optimizer
+  * \param optimizer the optimizer
+  */
+  void SetOptimizer(std::unique_ptr<Optimizer> optimizer);
+
+ private:
+  void CheckKeys() const;
+  std::vector<Executor *> execs_;
+  KVStore *kvstore_;
+  /*! \brief the positions of the parameters in arg_arrays, used as keys */
+  std::vector<int> keys_;
+  std::unique_ptr<Optimizer> optimizer_;
+  /*! \brief the lists passed to the optimizer, built once */
+  std::vector<int> update_indices_;
+  std::vector<NDArray> update_weights_, update_grads_;
+};
+
+}  // namespace cpp
+}  // namespace mxnet
+
+#endif  // MXNETCPP_TRAINER_H
@@ -0,0 +1,113 @@
+/*!
+ *  Copyright (c) 2016 by Contributors
+ * \file trainer.hpp
+ * \brief implementation of the kvstore trainer
+ */
+
+#ifndef MXNETCPP_TRAINER_HPP
+#define MXNETCPP_TRAINER_HPP
+
+#include <memory>
+#include <utility>
+#include <vector>
+#include "mxnet-cpp/trainer.h"
+#include "mxnet-cpp/optimizer.h"
+
+namespace mxnet {
+namespace cpp {
+
+KVStoreTrainer::KVStoreTrainer(Executor *exec, KVStore *kvstore,
+                               int arg_update_begin, int arg_update_end)
+    : execs_(1, exec), kvstore_(kvstore) {
+  CHECK(exec != nullptr);
+  CHECK(kvstore_ != nullptr);
+  int num_args = exec->arg_arrays.size();
+  arg_update_end = arg_update_end < 0 ? num_args - 1 : arg_update_end;
+  CHECK_LE(arg_update_end, num_args);
+  for (int i = arg_update_begin; i < arg_update_end; ++i) {
+    keys_.push_back(i);
+  }
+  CheckKeys();
+}
+
+KVStoreTrainer::KVStoreTrainer(const std::vector<Executor *> &execs,
+                               KVStore *kvstore,
+                               const std::vector<int> &arg_indices)
+    : execs_(execs), kvstore_(kvstore), keys_(arg_indices) {
+  CHECK(!execs_.empty());
+  CHECK(kvstore_ != nullptr);
+  CheckKeys();
+}
+
+void KVStoreTrainer::CheckKeys() const {
+  for (auto exec : execs_) {
+    CHECK(exec != nullptr);
+    for (int key : keys_) {
+      CHECK_LT(static_cast<size_t>(key), exec->grad_arrays.size());
+      CHECK_GT(exec->grad_arrays[key].GetShapeRef().ndim(), 0)
+          << "argument " << key << " is bound without gradient";
+    }
+  }
+}
+
+void KVStoreTrainer::Init() {
+  std::vector<NDArray> weights;
+  for (int key : keys_) {
+    weights.push_back(execs_[0]->arg_arrays[key]);
+  }
+  kvstore_->Init(keys_, weights);
+  std::vector<int> keys;
+  weights.clear();
+  for (int key : keys_) {
+    for (auto exec : execs_) {
+      keys.push_back(key);
+      weights.push_back(exec->arg_arrays[key]);
+    }
+  }
+  kvstore_->Pull(keys, &weights);
+}
+
+void KVStoreTrainer::Backward(const std::vector<NDArray> &head_grads) {
+  for (auto exec : execs_) {
+    exec->Backward(head_grads);
+  }
+  PushPull();
+}
+
+void KVStoreTrainer::PushPull() {
+  // one call per key, the priority is given per call
+  std::vector<int> keys(execs_.size());
+  std::vector<NDArray> grads(execs_.size()), weights(execs_.size());
+  for (int i = keys_.size() - 1; i >= 0; --i) {
+    for (size_t j = 0; j < execs_.size(); ++j) {
+      keys[j] = keys_[i];
+      grads[j] = execs_[j]->grad_arrays[keys_[i]];
+      weights[j] = execs_[j]->arg_arrays[keys_[i]];
+    }
+    kvstore_->Push(keys, grads, -i);
+    // the summed gradients replace the ones of the executors
+    kvstore_->Pull(keys, optimizer_ ? &grads : &weights, -i);
+  }
+  if (optimizer_) {
+    optimizer_->Update(update_indices_, update_weights_, update_grads_);
+  }
+}
+
+void KVStoreTrainer::SetOptimizer(std::unique_ptr<Optimizer> optimizer) {
+  optimizer_ = std::move(optimizer);
+  update_indices_.clear();
+  update_weights_.clear();
+  update_grads_.clear();
+  for (int key : keys_) {
+    for (size_t j = 0; j < execs_.size(); ++j) {
+      update_indices_.push_back(key * execs_.size() + j);
+      update_weights_.push_back(execs_[j]->arg_arrays[key]);
+      update_grads_.push_back(execs_[j]->grad_arrays[key]);
+    }
+  }
+}
+
+}  // namespace cpp
+}  // namespace mxnet
+
+#endif  // MXNETCPP_TRAINER_HPP
@@ -0,0 +1,64 @@
+/*!
+ *  Copyright (c) 2016 by Contributors
+ * \file metric_test.cpp
+ * \brief metrics given labels and predictions on different contexts
+ */
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "mxnet-cpp/MxNetCpp.h"
+
+using namespace mxnet::cpp;
+
+/*!
+* \brief evaluate a batch whose labels are on the CPU and whose predictions
+*  are on context, like the outputs of an executor bound on a GPU
+*/
+void TestMetrics(const Context &context) {
+  // 3 of the 4 examples are predicted right
+  std::vector<mx_float> probs = {0.7f, 0.2f, 0.1f,
+                                 0.1f, 0.8f, 0.1f,
+                                 0.2f, 0.3f, 0.5f,
+                                 0.6f, 0.3f, 0.1f};
+  std::vector<mx_float> classes = {0, 1, 2, 1};
+  NDArray labels(classes, Shape(4), Context::cpu());
+  NDArray preds(probs, Shape(4, 3), context);
+
+  Accuracy accuracy;
+  accuracy.Update(labels, preds);
+  // twice, so that the copy of the labels is reused
+  accuracy.Update(labels, preds);
+  CHECK_LT(std::fabs(accuracy.Get() - 0.75f), 1e-6);
+
+  CrossEntropy cross_entropy;
+  cross_entropy.Update(labels, preds);
+  float expected = -(std::log(0.7f) + std::log(0.8f) + std::log(0.5f) +
+                     std::log(0.3f)) / 4;
+  CHECK_LT(std::fabs(cross_entropy.Get() - expected), 1e-5);
+
+  NDArray values(std::vector<mx_float>{1, 2, 3, 4}, Shape(4),
+                 Context::cpu());
+  NDArray outputs(std::vector<mx_float>{1, 2, 3, 2}, Shape(4, 1), context);
+  MAE mae;
+  mae.Update(values, outputs);
+  CHECK_LT(std::fabs(mae.Get() - 0.5f), 1e-6);
+
+  CompositeEvalMetric composite;
+  composite.Add(std::make_shared<Accuracy>());
+  composite.Add(std::make_shared<TopKAccuracy>(2));
+  composite.Update(labels, preds);
+  auto name_values = composite.GetNameValue();
+  CHECK_EQ(name_values.size(), 2);
+  CHECK_LT(std::fabs(name_values[0].second - 0.75f), 1e-6);
+  CHECK_LT(std::fabs(name_values[1].second - 1.0f), 1e-6);
+}
+
+int main(int argc, char **argv) {
+  // another CPU context is already a different context
+  TestMetrics(Context::cpu(1));
+  if (argc > 1 && std::strcmp(argv[1], "gpu") == 0) {
+    TestMetrics(Context::gpu());
+  }
+  LG << "metric_test passed";
+  return 0;
+}
@@ -19,6 +19,7 @@ if [ ${TRAVIS_OS_NAME} == "linux" ]; then
 fi
 
 if [ ${TASK} == "build" ]; then
-    make example
+    make example || exit -1
+    make test
     exit $?
 fi